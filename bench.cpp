@@ -0,0 +1,271 @@
+// Benchmark of case generation: times the construction of the factory and of
+// both parts, SCAD serialization, the native mesh backend and (if installed)
+// rendering with OpenSCAD, for board files and synthetic boards. Results are
+// written as JSON to stdout, progress goes to stderr.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+
+#include "casefactory.h"
+#include "casejob.h"
+#include "boardfile.h"
+#include "mesh.h"
+#include "scadwriter.h"
+
+void usage()
+{
+    std::cerr << "Usage: casefactory-bench [--repeat=<n>] [--synthetic=<n>,...] [--openscad=<command>] [--mesh-limit=<n>]" << std::endl
+              << "                         [--dir=<directory>] [--<parameter>=<value> ...] [<board file> ...]" << std::endl
+              << std::endl
+              << "Times CaseFactory construction, part construction, SCAD serialization, the native mesh" << std::endl
+              << "backend and rendering with OpenSCAD (if the command works) for each board file and for" << std::endl
+              << "synthetic boards with the given feature counts (default 4,16,64). Parts with more than" << std::endl
+              << "<n> CSG nodes (--mesh-limit, default 1000, 0 = no meshing) aren't meshed. Each time is the" << std::endl
+              << "median of <n> runs (--repeat, default 5; OpenSCAD runs once). Prints the results as JSON." << std::endl
+              << "Fails if a mesh isn't closed (see triangulate() in mesh.h)." << std::endl;
+}
+
+
+
+typedef std::chrono::steady_clock Clock;
+
+// Median wall time of running f repeat times, in ms
+static double medianMilliseconds(int repeat, const std::function<void()> & f)
+{
+    std::vector<double> times;
+    for (int i = 0; i < repeat; i++) {
+        Clock::time_point start = Clock::now();
+        f();
+        times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+
+// A board with a grid of n x n forbidden areas on both sides, n ports on each
+// side, a screw hole in each corner plus n - 1 inner ones and n / 2 wall
+// supports, so the CSG tree grows with n like it does for real boards.
+static BoardDescription syntheticBoard(int n)
+{
+    BoardDescription board;
+    board.name = "synthetic-" + std::to_string(n);
+    board.size[0] = 20.0 * n + 40;
+    board.size[1] = 15.0 * n + 40;
+    board.thickness = 1.6;
+    board.holesRadius = 1.5;
+
+    double w = board.size[0], d = board.size[1];
+    board.holes = {{3.5, 3.5}, {w - 3.5, 3.5}, {3.5, d - 3.5}, {w - 3.5, d - 3.5}};
+    for (int i = 1; i < n; i++)
+        board.holes.push_back({20.0 * i + 20, d / 2});
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            double x = 20.0 * i + 22, y = 15.0 * j + 22;
+            board.bottomForbiddenAreas.push_back({x, y, 12, 8, 1.5 + (i + j) % 3});
+            board.topForbiddenAreas.push_back({x, y, 12, 8, 4.0 + (i * j) % 7});
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        double x = 20.0 * i + 25, y = 15.0 * i + 25;
+        board.bottomPorts.push_back({West, {{y, 2}, {y + 6, 2}}, 1.5, 1});
+        board.topPorts.push_back({North, {{x, 3}, {x + 8, 3}, {x + 8, -3}, {x, -3}}, 1, 2});
+        board.topPorts.push_back({South, {{x, 2}, {x, -3}}, 2.5, 1});
+        board.topPorts.push_back({East, {{y, 4}, {y + 5, 4}}, 2, 2});
+    }
+    for (int i = 0; i < n / 2; i++)
+        board.topWallSupports.push_back({East, 30.0 * i + 20, 4, 2});
+
+    return board;
+}
+
+
+// Number of facets in an ASCII or binary STL file, -1 if it can't be read
+static long stlFacetCount(const std::string & fileName)
+{
+    std::ifstream in(fileName, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (!in && !in.eof())
+        return -1;
+
+    uint32_t count;
+    if (data.size() >= 84) {
+        std::memcpy(&count, &data[80], 4);
+        if (data.size() == 84 + 50 * size_t(count))
+            return count;
+    }
+    if (data.compare(0, 5, "solid") != 0)
+        return -1;
+    long facets = 0;
+    for (size_t pos = data.find("facet normal"); pos != std::string::npos; pos = data.find("facet normal", pos + 1))
+        facets++;
+    return facets;
+}
+
+
+static bool benchmarkBoard(const BoardDescription & board, const ParameterList & parameters, int repeat,
+                           int meshLimit, const std::string & openscad, const std::string & dir,
+                           std::ostream & json, std::string & error)
+{
+    std::cerr << "Benchmarking " << board.name << std::endl;
+
+    CaseFactory factory(board);
+    double factoryTime = medianMilliseconds(repeat, [&] {
+        factory = CaseFactory(board);
+        configureFactory(factory, parameters, error);
+    });
+    if (!configureFactory(factory, parameters, error))
+        return false;
+
+    json << "    {\"name\": \"" << board.name << "\", \"constructFactoryMs\": " << factoryTime
+         << ", \"coalescedForbiddenAreas\": " << factory.coalescedForbiddenAreas() << ", \"parts\": [";
+    const char * separator = "\n";
+    for (CaseFactory::Side side : {CaseFactory::BottomSide, CaseFactory::TopSide}) {
+        std::string name = (side == CaseFactory::BottomSide) ? "bottom" : "top";
+        std::string fileName = dir + "/" + board.name + "-case-" + name;
+
+        Solid solid;
+        double constructTime = medianMilliseconds(repeat, [&] {
+            solid = (side == CaseFactory::BottomSide) ? factory.constructBottomSolid() : factory.constructTopSolid();
+        });
+
+        CsgStats stats;
+        bool written = true;
+        double writeTime = medianMilliseconds(repeat, [&] {
+            ScadWriter writer(fileName + ".scad");
+            writer.declareModules({solid});
+            writer.write(solid);
+            written = writer.close();
+            stats = writer.stats();
+        });
+        stats.facets = solid.primitiveFacets();
+        if (!written) {
+            error = "cannot write " + fileName + ".scad";
+            return false;
+        }
+
+        json << separator << "      {\"side\": \"" << name << "\", \"constructMs\": " << constructTime
+             << ", \"writeScadMs\": " << writeTime << ", \"nodes\": " << stats.nodes
+             << ", \"booleans\": " << stats.booleans << ", \"depth\": " << stats.depth
+             << ", \"bytes\": " << stats.bytes << ", \"primitiveFacets\": " << stats.facets
+             << ", \"culledSubtractions\": " << factory.culledSubtractions(side);
+        separator = ",\n";
+
+        if (stats.nodes > meshLimit) {
+            json << ", \"meshMs\": null, \"meshFacets\": null";
+        } else {
+            TriangleMesh mesh;
+            double meshTime = medianMilliseconds(repeat, [&] {
+                mesh = triangulate(evaluateMesh(solid));
+            });
+            size_t open = openEdges(mesh);
+            json << ", \"meshMs\": " << meshTime << ", \"meshFacets\": " << mesh.triangles.size()
+                 << ", \"meshOpenEdges\": " << open;
+            if (open) {
+                error = "the mesh of " + fileName + " is not closed (" + std::to_string(open) + " open edges)";
+                return false;
+            }
+        }
+
+        if (!openscad.empty()) {
+            std::cerr << "  rendering " << fileName << ".scad with " << openscad << std::endl;
+            std::string command = openscad + " -o '" + fileName + ".stl' '" + fileName + ".scad' > /dev/null 2>&1";
+            int status = 0;
+            double renderTime = medianMilliseconds(1, [&] { status = std::system(command.c_str()); });
+            long facets = (status == 0) ? stlFacetCount(fileName + ".stl") : -1;
+            json << ", \"openscadMs\": " << renderTime << ", \"openscadFacets\": " << facets;
+        }
+        json << "}";
+    }
+    json << "\n    ]}";
+    return true;
+}
+
+
+int main(int argc, char * argv[])
+{
+    int repeat = 5;
+    int meshLimit = 1000;
+    std::string openscad = "openscad";
+    std::string dir = "bench-output";
+    std::vector<int> synthetic = {4, 16, 64};
+    ParameterList parameters;
+    std::vector<std::string> boardFiles;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t equals = arg.find('=');
+        if (arg.compare(0, 9, "--repeat=") == 0) {
+            repeat = std::max(1, std::stoi(arg.substr(9)));
+        } else if (arg.compare(0, 12, "--synthetic=") == 0) {
+            synthetic.clear();
+            std::istringstream list(arg.substr(12));
+            std::string n;
+            while (std::getline(list, n, ','))
+                synthetic.push_back(std::stoi(n));
+        } else if (arg.compare(0, 11, "--openscad=") == 0) {
+            openscad = arg.substr(11);
+        } else if (arg.compare(0, 13, "--mesh-limit=") == 0) {
+            meshLimit = std::stoi(arg.substr(13));
+        } else if (arg.compare(0, 6, "--dir=") == 0) {
+            dir = arg.substr(6);
+        } else if (arg.compare(0, 2, "--") == 0 && equals != std::string::npos) {
+            parameters.push_back({arg.substr(2, equals - 2), arg.substr(equals + 1)});
+        } else if (arg.compare(0, 1, "-") != 0) {
+            boardFiles.push_back(arg);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::vector<BoardDescription> boards;
+    for (const std::string & fileName : boardFiles) {
+        BoardDescription board;
+        std::string error;
+        if (!readBoardFile(fileName, board, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        if (board.name.empty()) {
+            std::string base = fileName.substr(fileName.find_last_of('/') + 1);
+            board.name = base.substr(0, base.find('.'));
+        }
+        boards.push_back(board);
+    }
+    for (int n : synthetic)
+        boards.push_back(syntheticBoard(n));
+
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        std::cerr << "cannot create directory " << dir << std::endl;
+        return 1;
+    }
+    if (!openscad.empty() && std::system((openscad + " --version > /dev/null 2>&1").c_str()) != 0) {
+        std::cerr << "OpenSCAD not found (" << openscad << "), skipping renders" << std::endl;
+        openscad.clear();
+    }
+
+    std::ostream & json = std::cout;
+    json << "{\n  \"repeat\": " << repeat << ",\n  \"openscad\": " << (openscad.empty() ? "false" : "true")
+         << ",\n  \"boards\": [\n";
+    for (size_t i = 0; i < boards.size(); i++) {
+        std::string error;
+        if (!benchmarkBoard(boards[i], parameters, repeat, meshLimit, openscad, dir, json, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        json << (i + 1 < boards.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}" << std::endl;
+    return 0;
+}
@@ -1,6 +1,7 @@
 #ifndef BOARDDESCRIPTION_H
 #define BOARDDESCRIPTION_H
 
+#include <string>
 #include <vector>
 #include "geom.h"
 
@@ -93,7 +94,7 @@ struct BoardDescription
     std::vector<PortDescription> topPorts;
 
     // Some wall supports where the walls would be too tiny otherwise
-    // TODO: Maybe this can be calculated automatically?
+    // (the case factory can add more automatically, see CaseFactory::wallSupportMinSpan)
     std::vector<WallSupportDescription> bottomWallSupports;
     std::vector<WallSupportDescription> topWallSupports;
 };
@@ -0,0 +1,15 @@
+// Converts a board description written as C header (like cubieboard.h) to
+// a board file (see boardfile.h). The header is passed on the command line
+// with "-include", see the %.board rule in the Makefile.
+
+#include "boardfile.h"
+
+
+int main()
+{
+    BoardDescription board = makeBoard();
+    if (board.name.empty())
+        board.name = BOARD_NAME;
+    writeBoard(std::cout, board);
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include "boardfile.h"
+
+#include <fstream>
+#include <sstream>
+
+
+
+const char * sideName(Side side)
+{
+    switch (side) {
+    case North: return "North";
+    case East:  return "East";
+    case South: return "South";
+    case West:  return "West";
+    case Flat:  return "Flat";
+    }
+    return "?";
+}
+
+
+bool parseSide(const std::string & name, Side & side)
+{
+    for (Side s : {North, East, South, West, Flat}) {
+        if (name == sideName(s)) {
+            side = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static bool readValue(std::istream & in, double & value)
+{
+    return bool(in >> value);
+}
+
+static bool readValue(std::istream & in, int & value)
+{
+    return bool(in >> value);
+}
+
+static bool readValue(std::istream & in, Side & side)
+{
+    std::string name;
+    return (in >> name) && parseSide(name, side);
+}
+
+static bool readArea(std::istream & in, ForbiddenAreaDescription & area)
+{
+    return readValue(in, area.x) && readValue(in, area.y)
+            && readValue(in, area.sx) && readValue(in, area.sy) && readValue(in, area.sz);
+}
+
+static bool readPort(std::istream & in, PortDescription & port)
+{
+    if (!readValue(in, port.side) || !readValue(in, port.radius) || !readValue(in, port.outset))
+        return false;
+    Point p;
+    while (in >> p.x) {
+        if (!readValue(in, p.y))
+            return false;
+        port.path.push_back(p);
+    }
+    return !port.path.empty() && in.eof();
+}
+
+static bool readWallSupport(std::istream & in, WallSupportDescription & support)
+{
+    return readValue(in, support.side) && readValue(in, support.pos)
+            && readValue(in, support.size) && readValue(in, support.inset);
+}
+
+static bool readHoleNut(std::istream & in, HoleNutDescription & nut)
+{
+    return readValue(in, nut.holeIndex) && readValue(in, nut.nutWidth) && readValue(in, nut.nutThickness)
+            && readValue(in, nut.nutCavityHeightFromBottom) && readValue(in, nut.side);
+}
+
+
+bool readBoard(std::istream & in, BoardDescription & board, std::string & error)
+{
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key))
+            continue;
+
+        bool ok;
+        if (key == "name") {
+            ok = bool(fields >> board.name);
+        } else if (key == "size") {
+            ok = readValue(fields, board.size[0]) && readValue(fields, board.size[1]);
+        } else if (key == "thickness") {
+            ok = readValue(fields, board.thickness);
+        } else if (key == "holesRadius") {
+            ok = readValue(fields, board.holesRadius);
+        } else if (key == "hole") {
+            Point p;
+            ok = readValue(fields, p.x) && readValue(fields, p.y);
+            board.holes.push_back(p);
+        } else if (key == "holeNut") {
+            HoleNutDescription nut;
+            ok = readHoleNut(fields, nut);
+            board.holeNuts.push_back(nut);
+        } else if (key == "bottomForbiddenArea" || key == "topForbiddenArea" || key == "topHole") {
+            ForbiddenAreaDescription area;
+            ok = readArea(fields, area);
+            auto & areas = (key == "bottomForbiddenArea") ? board.bottomForbiddenAreas
+                         : (key == "topForbiddenArea")    ? board.topForbiddenAreas
+                         :                                  board.topHoles;
+            areas.push_back(area);
+        } else if (key == "bottomPort" || key == "topPort") {
+            PortDescription port;
+            ok = readPort(fields, port);
+            (key == "bottomPort" ? board.bottomPorts : board.topPorts).push_back(port);
+        } else if (key == "bottomWallSupport" || key == "topWallSupport") {
+            WallSupportDescription support;
+            ok = readWallSupport(fields, support);
+            (key == "bottomWallSupport" ? board.bottomWallSupports : board.topWallSupports).push_back(support);
+        } else {
+            error = "line " + std::to_string(lineNumber) + ": unknown statement '" + key + "'";
+            return false;
+        }
+
+        // Anything left on the line is an error, too.
+        std::string rest;
+        fields.clear();
+        if (!ok || fields >> rest) {
+            error = "line " + std::to_string(lineNumber) + ": invalid '" + key + "' statement";
+            return false;
+        }
+    }
+
+    for (auto holeNut : board.holeNuts) {
+        if (holeNut.holeIndex < 0 || holeNut.holeIndex >= int(board.holes.size())) {
+            error = "holeNut refers to hole " + std::to_string(holeNut.holeIndex)
+                    + ", but there are only " + std::to_string(board.holes.size()) + " holes";
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool readBoardFile(const std::string & fileName, BoardDescription & board, std::string & error)
+{
+    std::ifstream in(fileName);
+    if (!in) {
+        error = "cannot open " + fileName;
+        return false;
+    }
+    if (!readBoard(in, board, error)) {
+        error = fileName + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+
+
+static void writeArea(std::ostream & out, const char * key, const ForbiddenAreaDescription & area)
+{
+    out << key << " " << area.x << " " << area.y << " " << area.sx << " " << area.sy << " " << area.sz << "\n";
+}
+
+static void writePort(std::ostream & out, const char * key, const PortDescription & port)
+{
+    out << key << " " << sideName(port.side) << " " << port.radius << " " << port.outset;
+    for (Point p : port.path)
+        out << "  " << p.x << " " << p.y;
+    out << "\n";
+}
+
+static void writeWallSupport(std::ostream & out, const char * key, const WallSupportDescription & support)
+{
+    out << key << " " << sideName(support.side) << " " << support.pos << " " << support.size << " " << support.inset << "\n";
+}
+
+
+void writeBoard(std::ostream & out, const BoardDescription & board)
+{
+    // Enough digits to read back the same doubles, but no noise like 99.900000000000006
+    std::streamsize precision = out.precision(15);
+
+    out << "# Board description for the OOML case factory, see boardfile.h\n";
+    if (!board.name.empty())
+        out << "name " << board.name << "\n";
+    out << "size " << board.size[0] << " " << board.size[1] << "\n";
+    out << "thickness " << board.thickness << "\n";
+    out << "holesRadius " << board.holesRadius << "\n";
+
+    for (Point p : board.holes)
+        out << "hole " << p.x << " " << p.y << "\n";
+    for (auto nut : board.holeNuts)
+        out << "holeNut " << nut.holeIndex << " " << nut.nutWidth << " " << nut.nutThickness << " "
+            << nut.nutCavityHeightFromBottom << " " << sideName(nut.side) << "\n";
+
+    for (auto area : board.bottomForbiddenAreas) writeArea(out, "bottomForbiddenArea", area);
+    for (auto area : board.topForbiddenAreas)    writeArea(out, "topForbiddenArea", area);
+    for (auto area : board.topHoles)             writeArea(out, "topHole", area);
+
+    for (auto port : board.bottomPorts) writePort(out, "bottomPort", port);
+    for (auto port : board.topPorts)    writePort(out, "topPort", port);
+
+    for (auto support : board.bottomWallSupports) writeWallSupport(out, "bottomWallSupport", support);
+    for (auto support : board.topWallSupports)    writeWallSupport(out, "topWallSupport", support);
+
+    out.precision(precision);
+}
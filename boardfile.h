@@ -0,0 +1,46 @@
+#ifndef BOARDFILE_H
+#define BOARDFILE_H
+
+#include <iostream>
+#include <string>
+#include "boarddescription.h"
+
+
+// Board descriptions can be loaded at runtime from a simple text file, so
+// a prebuilt casefactory binary can serve any board. One statement per
+// line, "#" starts a comment. Lengths are in mm, sides are one of North,
+// East, South, West or Flat. See boarddescription.h for the meaning of the
+// fields.
+//
+//   name                 cubieboard
+//   size                 99.9 60
+//   thickness            1.6
+//   holesRadius          1.5
+//   hole                 x y
+//   holeNut              holeIndex nutWidth nutThickness nutCavityHeightFromBottom side
+//   bottomForbiddenArea  x y sx sy sz
+//   topForbiddenArea     x y sx sy sz
+//   topHole              x y sx sy sz
+//   bottomPort           side radius outset x1 y1 x2 y2 ...
+//   topPort              side radius outset x1 y1 x2 y2 ...
+//   bottomWallSupport    side pos size inset
+//   topWallSupport       side pos size inset
+//
+// Boards written as C headers (like cubieboard.h) can be converted with
+// "make <name>.board".
+
+
+// Reads a board description. On failure, returns false and sets error to a
+// message including the line number. If the file has no "name", the name
+// is left unchanged.
+bool readBoard(std::istream & in, BoardDescription & board, std::string & error);
+bool readBoardFile(const std::string & fileName, BoardDescription & board, std::string & error);
+
+// Writes a board description in the format read by readBoard().
+void writeBoard(std::ostream & out, const BoardDescription & board);
+
+const char * sideName(Side side);
+bool parseSide(const std::string & name, Side & side);
+
+
+#endif // BOARDFILE_H
@@ -1,20 +1,35 @@
 #include "casefactory.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "forbiddenareas.h"
+#include "trace.h"
+
 
 
 
 CaseFactory::CaseFactory(BoardDescription board) :
     board(board)
 {
+    TraceScope trace("CaseFactory");
+
+    // Areas covered by others or combining into one cuboid only cost booleans. The board keeps the areas as
+    // given, as layout() and the checks refer to them by index.
+    bottomCutAreas = board.bottomForbiddenAreas;
+    topCutAreas = board.topForbiddenAreas;
+    coalescedAreas = coalesceForbiddenAreas(bottomCutAreas) + coalesceForbiddenAreas(topCutAreas);
+
     // Calculate the maximum dimensions in z direction
 
     // TODO: Can we do this nicer with some code extraction?
     boardBottomInnerHeight = 0.0;
-    for (auto area : board.bottomForbiddenAreas) {
+    for (const auto & area : board.bottomForbiddenAreas) {
         boardBottomInnerHeight = std::max(boardBottomInnerHeight,
                                           area.sz);
     }
-    for (auto port : board.bottomPorts) {
+    for (const auto & port : board.bottomPorts) {
         for (Point p : port.path) {
             boardBottomInnerHeight = std::max(boardBottomInnerHeight,
                                               p.y + port.radius);
@@ -22,11 +37,11 @@ CaseFactory::CaseFactory(BoardDescription board) :
     }
 
     boardTopInnerHeight = 0.0;
-    for (auto area : board.topForbiddenAreas) {
+    for (const auto & area : board.topForbiddenAreas) {
         boardTopInnerHeight = std::max(boardTopInnerHeight,
                                           area.sz);
     }
-    for (auto port : board.topPorts) {
+    for (const auto & port : board.topPorts) {
 	if(port.side == Flat) continue; // we do not count top ports towrds the height
         for (Point p : port.path) {
             boardTopInnerHeight = std::max(boardTopInnerHeight,
@@ -38,11 +53,23 @@ CaseFactory::CaseFactory(BoardDescription board) :
 
 Component CaseFactory::constructBottom()
 {
-    return constructPart(BottomSide);
+    return constructPart(BottomSide).toComponent();
 }
 
 
 Component CaseFactory::constructTop()
+{
+    return constructPart(TopSide).toComponent();
+}
+
+
+Solid CaseFactory::constructBottomSolid()
+{
+    return constructPart(BottomSide);
+}
+
+
+Solid CaseFactory::constructTopSolid()
 {
     return constructPart(TopSide);
 }
@@ -54,41 +81,644 @@ Vec CaseFactory::outerDimensions()
 }
 
 
-Component CaseFactory::constructPart(Side whichSide)
+CaseMeasures CaseFactory::measure()
+{
+    CaseMeasures measures;
+    measures.outer = outerDimensions();
+    double wall[2], floor[2];
+    measures.material = measurePart(BottomSide, wall[0], floor[0]).volume + measurePart(TopSide, wall[1], floor[1]).volume;
+    measures.thinnestWall = std::min(wall[0], wall[1]);
+    measures.thinnestFloor = std::min(floor[0], floor[1]);
+    return measures;
+}
+
+
+// Axes of a Vec, to handle all three alike
+static double Vec::* const axes[3] = {&Vec::x, &Vec::y, &Vec::z};
+
+
+// The part of the convex polygon within the rectangle (Sutherland-Hodgman, one side after the other)
+static std::vector<Point> clipToRectangle(std::vector<Point> polygon, Point min, Point max)
+{
+    const struct {
+        double Point::* coordinate;
+        double limit;
+        double sign; // inside where sign * (coordinate - limit) >= 0
+    } sides[] = {{&Point::x, min.x, 1}, {&Point::x, max.x, -1}, {&Point::y, min.y, 1}, {&Point::y, max.y, -1}};
+
+    for (const auto & side : sides) {
+        std::vector<Point> clipped;
+        for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+            const Point & a = polygon[j];
+            const Point & b = polygon[i];
+            double da = side.sign * (a.*side.coordinate - side.limit);
+            double db = side.sign * (b.*side.coordinate - side.limit);
+            if ((da >= 0) != (db >= 0)) {
+                double t = da / (da - db);
+                Point p = {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+                p.*side.coordinate = side.limit;
+                clipped.push_back(p);
+            }
+            if (db >= 0)
+                clipped.push_back(b);
+        }
+        polygon.swap(clipped);
+    }
+    return polygon;
+}
+
+
+// The part of the polygon within the convex polygon (counterclockwise)
+static std::vector<Point> clipToConvex(std::vector<Point> polygon, const std::vector<Point> & convex)
+{
+    for (size_t k = 0, l = convex.size() - 1; k < convex.size() && !polygon.empty(); l = k++) {
+        const Point & c = convex[l];
+        const Point & d = convex[k];
+        auto inside = [&](const Point & p) { return (d.x - c.x) * (p.y - c.y) - (d.y - c.y) * (p.x - c.x); };
+        std::vector<Point> clipped;
+        for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+            const Point & a = polygon[j];
+            const Point & b = polygon[i];
+            double da = inside(a);
+            double db = inside(b);
+            if ((da >= 0) != (db >= 0)) {
+                double t = da / (da - db);
+                clipped.push_back({a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t});
+            }
+            if (db >= 0)
+                clipped.push_back(b);
+        }
+        polygon.swap(clipped);
+    }
+    return polygon;
+}
+
+
+// Length of the edges of the polygon which lie on the sides of the rectangle
+static double lengthOnRectangle(const std::vector<Point> & polygon, Point min, Point max)
+{
+    auto same = [](double x, double y) { return std::abs(x - y) < 1e-6; };
+    double length = 0;
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        const Point & p = polygon[j];
+        const Point & q = polygon[i];
+        if ((same(p.x, min.x) && same(q.x, min.x)) || (same(p.x, max.x) && same(q.x, max.x)) ||
+            (same(p.y, min.y) && same(q.y, min.y)) || (same(p.y, max.y) && same(q.y, max.y)))
+            length += std::hypot(q.x - p.x, q.y - p.y);
+    }
+    return length;
+}
+
+
+// The cross section of the feature's prism (see CaseFeature): the hull of the profile grown by the radius (with
+// the circles as 32-gons), or the bounds in the xy plane for a box
+static std::vector<Point> crossSection(const CaseFeature & feature)
+{
+    std::vector<Point> section;
+    if (feature.axis < 0) {
+        const Box & b = feature.bounds;
+        return {{b.min.x, b.min.y}, {b.max.x, b.min.y}, {b.max.x, b.max.y}, {b.min.x, b.max.y}};
+    }
+    for (Point p : feature.profile) {
+        for (int k = 0; k < 32; k++)
+            section.push_back({p.x + feature.radius * std::cos(k * M_PI / 16), p.y + feature.radius * std::sin(k * M_PI / 16)});
+    }
+    return convexHull(section);
+}
+
+
+// Subtracts (weight 1) the overlap of the box of an additive feature with another feature from the estimate, or
+// adds it back (weight -1). A subtractive feature cuts the overlap out of the box, an additive one was counted
+// twice. The overlap is the feature's prism (see CaseFeature) clipped to the box. Of its faces, the ones on the
+// surface of the box are lost, the others are new surface where a hole is cut into the box, and covered where
+// an additive feature overlaps it. The floor beneath the box counts as its top in measurePart, so only the top
+// of the box is lost, and horizontal faces only count where something is cut.
+static void subtractOverlap(const Box & box, const CaseFeature & feature, double weight, PartEstimate & part)
+{
+    int axis = (feature.axis < 0) ? 2 : feature.axis;
+    double Vec::* a = axes[axis];
+    double Vec::* u = axes[axis == 0 ? 1 : 0];
+    double Vec::* v = axes[axis == 2 ? 1 : 2];
+    double lo = std::max(feature.bounds.min.*a, box.min.*a);
+    double hi = std::min(feature.bounds.max.*a, box.max.*a);
+    if (hi <= lo)
+        return;
+
+    Point min = {box.min.*u, box.min.*v};
+    Point max = {box.max.*u, box.max.*v};
+    std::vector<Point> section = clipToRectangle(crossSection(feature), min, max);
+    double area = polygonArea(section);
+    if (section.size() < 3 || area <= 0)
+        return;
+    double length = hi - lo;
+    part.volume -= weight * area * length;
+
+    auto face = [&](double faceArea, bool vertical, bool onBox) {
+        if (vertical)
+            part.verticalArea -= weight * ((onBox || feature.additive()) ? faceArea : -faceArea);
+        else if (!feature.additive())
+            part.horizontalArea -= weight * (onBox ? faceArea : -faceArea);
+    };
+    auto same = [](double x, double y) { return std::abs(x - y) < 1e-6; };
+    for (size_t i = 0, j = section.size() - 1; i < section.size(); j = i++) {
+        const Point & p = section[j];
+        const Point & q = section[i];
+        double edge = std::hypot(q.x - p.x, q.y - p.y);
+        // Across x or y, the sides are vertical where their normal is mostly horizontal (v is z)
+        bool vertical = axis == 2 || std::abs(q.x - p.x) < 0.7 * edge;
+        bool onBox = (same(p.x, min.x) && same(q.x, min.x)) || (same(p.x, max.x) && same(q.x, max.x)) ||
+                     (same(p.y, max.y) && same(q.y, max.y)) || (vertical && same(p.y, min.y) && same(q.y, min.y));
+        face(edge * length, vertical, onBox);
+    }
+    face(area, axis != 2, same(lo, box.min.*a) && axis != 2);
+    face(area, axis != 2, same(hi, box.max.*a));
+}
+
+
+PartEstimate CaseFactory::estimatePart(Side side)
+{
+    double thinnestWall, thinnestFloor;
+    PartEstimate part = measurePart(side, thinnestWall, thinnestFloor);
+
+    // measurePart counts each feature on its own. Correct that where the screw enclosures and wall supports
+    // overlap the walls of the cavity, each other and the holes and forbidden areas cutting them, by
+    // inclusion-exclusion: subtract the overlaps of pairs, and add back the overlaps of two cuts within the same
+    // box where one of them is a box as well. The screw holes are already counted through their own enclosures,
+    // and the chamfers stay outside of the cavity.
+    PartLayout parts = layout(side);
+    const Box & cavity = parts.cavity;
+    for (size_t i = 0; i < parts.features.size(); i++) {
+        const CaseFeature & feature = parts.features[i];
+        if (!feature.additive())
+            continue;
+        Box box = feature.bounds.intersection(cavity);
+        if (box.empty())
+            continue;
+
+        // The sides against the walls are neither surface of the box nor of the wall any more
+        Vec size = box.max - box.min;
+        double lost = ((box.min.x == cavity.min.x) + (box.max.x == cavity.max.x)) * size.y +
+                      ((box.min.y == cavity.min.y) + (box.max.y == cavity.max.y)) * size.x;
+        part.verticalArea -= 2 * lost * size.z;
+
+        std::vector<CaseFeature> cuts;
+        for (size_t j = 0; j < parts.features.size(); j++) {
+            CaseFeature other = parts.features[j];
+            bool ownHole = feature.kind == CaseFeature::ScrewEnclosure && feature.index == other.index &&
+                           (other.kind == CaseFeature::ScrewHole || other.kind == CaseFeature::ScrewHeadHole);
+            if ((other.additive() && j <= i) || ownHole || other.kind == CaseFeature::PortChamfer)
+                continue;
+            if (other.additive())
+                other.bounds = other.bounds.intersection(cavity);
+            else
+                cuts.push_back(other);
+            subtractOverlap(box, other, 1, part);
+        }
+        for (size_t j = 0; j < cuts.size(); j++) {
+            for (size_t k = 0; k < cuts.size(); k++) {
+                if (k != j && cuts[j].axis < 0 && (cuts[k].axis >= 0 || k > j))
+                    subtractOverlap(box.intersection(cuts[j].bounds), cuts[k], -1, part);
+            }
+        }
+    }
+
+    // The port holes in the floor and the forbidden areas reaching into it are taken whole by measurePart, also
+    // where they reach past the outer walls or overlap each other. Replace them by their parts within the outline
+    // of the part, minus the overlaps of pairs. Where a hole goes through, the floor loses its bottom, and within
+    // the cavity its top. Along the outline, the hole's side replaces the outer wall.
+    Point outerMin = {parts.outer.min.x, parts.outer.min.y};
+    Point outerMax = {parts.outer.max.x, parts.outer.max.y};
+    Point cavityMin = {cavity.min.x, cavity.min.y};
+    Point cavityMax = {cavity.max.x, cavity.max.y};
+    double floorTop = cavity.min.z;
+    auto cut = [&](const std::vector<Point> & section, double depth, bool through, double weight) {
+        part.volume -= weight * polygonArea(section) * depth;
+        part.verticalArea += weight * (polygonPerimeter(section) - 2 * lengthOnRectangle(section, outerMin, outerMax)) * depth;
+        if (through)
+            part.horizontalArea -= weight * 2 * polygonArea(clipToRectangle(section, cavityMin, cavityMax));
+    };
+    std::vector<CaseFeature> floorCuts;
+    for (const CaseFeature & feature : parts.features) {
+        bool flatPort = feature.kind == CaseFeature::PortHole && feature.axis == 2;
+        if ((flatPort || feature.kind == CaseFeature::ForbiddenArea) && feature.bounds.min.z < floorTop) {
+            // As counted by measurePart
+            std::vector<Point> section = crossSection(feature);
+            double depth = floorTop - std::max(feature.bounds.min.z, 0.0);
+            part.volume += polygonArea(section) * depth;
+            part.verticalArea -= polygonPerimeter(section) * depth;
+            if (flatPort)
+                part.horizontalArea += polygonArea(section);
+            cut(clipToRectangle(section, outerMin, outerMax), depth, feature.bounds.min.z <= 0, 1);
+            floorCuts.push_back(feature);
+        }
+    }
+    for (size_t j = 0; j < floorCuts.size(); j++) {
+        for (size_t k = j + 1; k < floorCuts.size(); k++) {
+            double bottom = std::max(std::max(floorCuts[j].bounds.min.z, floorCuts[k].bounds.min.z), 0.0);
+            std::vector<Point> overlap = clipToConvex(clipToRectangle(crossSection(floorCuts[j]), outerMin, outerMax),
+                                                      crossSection(floorCuts[k]));
+            if (overlap.size() >= 3)
+                cut(overlap, floorTop - bottom, bottom <= 0, -1);
+        }
+    }
+
+    // Each vertical surface is traced by the perimeters in every layer, flat surfaces get solid layers, and the
+    // rest is infill. All of it is extruded in lines of printLineWidth x printLayerHeight.
+    double layerHeight = std::max(printLayerHeight, .01);
+    double line = printLineWidth * layerHeight;
+    double perimeterLength = part.verticalArea * printPerimeters / layerHeight;
+    double rest = std::max(part.volume - perimeterLength * line, 0.0);
+    double solid = std::min(part.horizontalArea * printSolidLayers * layerHeight, rest);
+    double infillLength = (solid + (rest - solid) * printInfillDensity) / line;
+    part.printTime = perimeterLength / printPerimeterSpeed + infillLength / printInfillSpeed +
+                     std::ceil(part.height / layerHeight) * printLayerTime;
+    return part;
+}
+
+
+PartEstimate CaseFactory::measurePart(Side whichSide, double & thinnestWall, double & thinnestFloor)
+{
+    // Same selection as in constructPart
+    auto innerHeight     = (whichSide == BottomSide) ? bottomInnerHeight()        : topInnerHeight();
+    auto outerHeight     = (whichSide == BottomSide) ? bottomHeight()             : topHeight();
+    auto & forbiddenAreas  = (whichSide == BottomSide) ? board.bottomForbiddenAreas : board.topForbiddenAreas;
+    auto & ports           = (whichSide == BottomSide) ? board.bottomPorts          : board.topPorts;
+    auto wallSupports    = this->wallSupports(whichSide);
+    auto extension       = (whichSide == outerExtensionOnSide) ? ExtensionOutside : ExtensionInside;
+    auto screwHoleRadius =((whichSide == screwHeadsOnSide) ? holesAddRadiusLoose : holesAddRadiusTight) + board.holesRadius;
+    auto screwHeads      = (whichSide == screwHeadsOnSide);
+
+    PartEstimate part;
+    double & volume = part.volume;
+    double & vertical = part.verticalArea;
+    double & horizontal = part.horizontalArea;
+    part.height = outerHeight + extensionHeight();
+    double cavity[2] = {board.size[0] + 2*space, board.size[1] + 2*space};
+
+    // Base: walls and floor, and the extension as in constructBase. The rim and the extension on top of it
+    // cover the same area as the floor minus the cavity.
+    volume = outerWidth() * outerDepth() * outerHeight - cavity[0] * cavity[1] * innerHeight;
+    vertical = 2 * (outerWidth() + outerDepth()) * outerHeight + 2 * (cavity[0] + cavity[1]) * innerHeight;
+    horizontal = 2 * outerWidth() * outerDepth();
+    double off_ext_outer = walls * (extension ? 1.00 : 0.45) + space;
+    double off_ext_inner = walls * (extension ? 0.55 : 0.00) + space;
+    volume += ((board.size[0] + 2*off_ext_outer) * (board.size[1] + 2*off_ext_outer) -
+               (board.size[0] + 2*off_ext_inner) * (board.size[1] + 2*off_ext_inner)) * extensionHeight();
+    vertical += 2 * (2 * board.size[0] + 2 * board.size[1] + 4 * (off_ext_outer + off_ext_inner)) * extensionHeight();
+
+    // Rounded corners: the vertical edges and the edges of the floor lose (1 - pi/4) r^2 per length, and a
+    // quarter circle of length pi/2 r replaces two faces of length r. The surfaces along the floor edges are
+    // counted half as vertical.
+    thinnestWall = walls;
+    thinnestFloor = floors;
+    if (cornerRadius > 0.0) {
+        double r = cornerRadius;
+        double floorEdges = 2 * (outerWidth() + outerDepth() - 4 * r);
+        volume -= (1 - M_PI / 4) * r * r * (4 * outerHeight + floorEdges);
+        vertical -= (2 - M_PI / 2) * r * 4 * outerHeight + (1 - M_PI / 4) * r * floorEdges;
+        horizontal -= (1 - M_PI / 4) * r * floorEdges;
+
+        // In the corners of the floor, the sphere comes closest to the cavity
+        double dw = std::max(r - walls, 0.0);
+        double df = std::max(r - floors, 0.0);
+        if (dw > 0 || df > 0)
+            thinnestWall = std::min(thinnestWall, r - std::sqrt(2 * dw * dw + df * df));
+    }
+
+    // Wall supports, inside the cavity
+    for (const auto & wallSupport : wallSupports) {
+        volume += wallSupport.size * (wallSupport.inset + space) * innerHeight;
+        vertical += (wallSupport.size + 2 * (wallSupport.inset + space)) * innerHeight;
+    }
+
+    // Screw hole enclosures inside the cavity, minus the holes
+    double ro = holesSize / 2.0 + holesWalls;
+    double ri = holesSize / 2.0;
+    double holeStart = screwHeads ? (outerHeight - holesFloors) + (printLayerHeight * printSafeBridgeLayerCount) : floors;
+    for (const auto & hole : board.holes) {
+        double sx = std::max(std::min(hole.x + ro, board.size[0] + space) - std::max(hole.x - ro, -space), 0.0);
+        double sy = std::max(std::min(hole.y + ro, board.size[1] + space) - std::max(hole.y - ro, -space), 0.0);
+        volume += sx * sy * innerHeight;
+        vertical += 2 * (sx + sy) * innerHeight;
+        volume -= M_PI * screwHoleRadius * screwHoleRadius * (outerHeight - holeStart);
+        vertical += 2 * M_PI * screwHoleRadius * (outerHeight - holeStart);
+        if (screwHeads) {
+            volume -= M_PI * ri * ri * (outerHeight - holesFloors);
+            vertical += 2 * M_PI * ri * (outerHeight - holesFloors);
+        } else {
+            horizontal -= M_PI * screwHoleRadius * screwHoleRadius;
+        }
+    }
+
+    // Port holes: the hull of circles along the path is the convex hull of the path, grown by the radius
+    for (const auto & port : ports) {
+        std::vector<Point> hull = convexHull(port.path);
+        double r = port.radius;
+        double area = polygonArea(hull) + polygonPerimeter(hull) * r + M_PI * r * r;
+        double perimeter = polygonPerimeter(hull) + 2 * M_PI * r;
+        if (port.side == Flat) {
+            volume -= area * floors;
+            vertical += perimeter * floors;
+            horizontal -= area;
+            continue;
+        }
+
+        double uMin = 1e9, uMax = -1e9, zMin = 1e9, zMax = -1e9;
+        for (Point p : port.path) {
+            uMin = std::min(uMin, p.x - r);
+            uMax = std::max(uMax, p.x + r);
+            zMin = std::min(zMin, p.y - r);
+            zMax = std::max(zMax, p.y + r);
+        }
+        // Only the part of the hole between the edge of the extension and the outer floor cuts this part
+        double zInside = std::min(zMax, outerHeight) - std::max(zMin, -extensionHeight());
+        if (zInside > 0) {
+            double fraction = zInside / (zMax - zMin);
+            volume -= area * fraction * walls;
+            vertical += (perimeter * walls - 2 * area) * fraction;
+        }
+
+        thinnestWall = std::min(thinnestWall, outerHeight - zMax);
+        double length = (port.side == North || port.side == South) ? board.size[0] : board.size[1];
+        if (uMin >= 0 && uMax <= length)
+            thinnestWall = std::min(thinnestWall, std::min(uMin, length - uMax) + outset() - cornerRadius);
+    }
+
+    // Forbidden areas reaching into the floor
+    for (const auto & area : forbiddenAreas) {
+        if (area.sz > innerHeight) {
+            double depth = std::min(area.sz, outerHeight) - innerHeight;
+            volume -= area.sx * area.sy * depth;
+            vertical += 2 * (area.sx + area.sy) * depth;
+            thinnestFloor = std::min(thinnestFloor, outerHeight - area.sz);
+        }
+    }
+
+    return part;
+}
+
+
+PartLayout CaseFactory::layout(Side whichSide)
+{
+    // Same selection as in constructPart
+    auto innerHeight     = (whichSide == BottomSide) ? bottomInnerHeight()        : topInnerHeight();
+    auto outerHeight     = (whichSide == BottomSide) ? bottomHeight()             : topHeight();
+    auto & forbiddenAreas  = (whichSide == BottomSide) ? board.bottomForbiddenAreas : board.topForbiddenAreas;
+    auto & ports           = (whichSide == BottomSide) ? board.bottomPorts          : board.topPorts;
+    auto wallSupports    = this->wallSupports(whichSide);
+    auto screwHoleRadius =((whichSide == screwHeadsOnSide) ? holesAddRadiusLoose : holesAddRadiusTight) + board.holesRadius;
+    auto screwHeads      = (whichSide == screwHeadsOnSide);
+
+    PartLayout layout;
+    layout.outer.extend(Vec{-outset(), -outset(), 0});
+    layout.outer.extend(Vec{board.size[0] + outset(), board.size[1] + outset(), outerHeight});
+    layout.cavity.extend(Vec{-space, -space, outerHeight - innerHeight});
+    layout.cavity.extend(Vec{board.size[0] + space, board.size[1] + space, outerHeight});
+
+    auto add = [&](CaseFeature::Kind kind, int index, const Solid & solid) -> CaseFeature & {
+        CaseFeature feature;
+        feature.kind = kind;
+        feature.index = index;
+        feature.bounds = solid.bounds();
+        layout.features.push_back(feature);
+        return layout.features.back();
+    };
+
+    for (size_t i = 0; i < wallSupports.size(); i++)
+        add(CaseFeature::WallSupport, i, wallSupport(outerHeight, wallSupports[i]));
+
+    double ri = holesSize / 2.0;
+    for (size_t i = 0; i < board.holes.size(); i++) {
+        Solid enclosure, hole, headHole;
+        Point pos = board.holes[i];
+        screwHole(outerHeight, pos, screwHoleRadius, screwHeads, enclosure, hole, headHole);
+        add(CaseFeature::ScrewEnclosure, i, enclosure);
+        CaseFeature & holeFeature = add(CaseFeature::ScrewHole, i, hole);
+        holeFeature.axis = 2;
+        holeFeature.profile = {pos};
+        holeFeature.radius = screwHoleRadius;
+        if (screwHeads) {
+            CaseFeature & headFeature = add(CaseFeature::ScrewHeadHole, i, headHole);
+            headFeature.axis = 2;
+            headFeature.profile = {pos};
+            headFeature.radius = ri;
+        }
+    }
+
+    if (whichSide == TopSide) {
+        for (size_t i = 0; i < board.holeNuts.size(); i++) {
+            const HoleNutDescription & holeNut = board.holeNuts[i];
+            if (holeNut.holeIndex >= 0 && holeNut.holeIndex < int(board.holes.size()))
+                add(CaseFeature::NutCavity, i, nutCavity(board.holes[holeNut.holeIndex], holeNut));
+        }
+    }
+
+    // The port holes are prisms across the wall, see portHole
+    for (size_t i = 0; i < ports.size(); i++) {
+        const PortDescription & port = ports[i];
+        Solid hole, chamfer;
+        portHole(outerHeight, port, hole, chamfer);
+
+        int axis = (port.side == North || port.side == South) ? 1 : (port.side == Flat) ? 2 : 0;
+        std::vector<Point> profile;
+        for (Point p : port.path)
+            profile.push_back((port.side == Flat) ? p : Point{p.x, outerHeight - p.y});
+        double coneLength = walls + space - port.outset;
+
+        CaseFeature & holeFeature = add(CaseFeature::PortHole, i, hole);
+        holeFeature.axis = axis;
+        holeFeature.profile = profile;
+        holeFeature.radius = port.radius;
+        if (preview)
+            continue;
+        CaseFeature & chamferFeature = add(CaseFeature::PortChamfer, i, chamfer);
+        chamferFeature.axis = axis;
+        chamferFeature.profile = profile;
+        chamferFeature.radius = port.radius + coneLength + 2 * eps;
+    }
+
+    for (size_t i = 0; i < forbiddenAreas.size(); i++) {
+        const ForbiddenAreaDescription & area = forbiddenAreas[i];
+        add(CaseFeature::ForbiddenArea, i, Solid::cube(area.sx, area.sy, area.sz + extensionHeight() + eps)
+                .translatedCopy(area.x, area.y, outerHeight - area.sz));
+    }
+
+    return layout;
+}
+
+
+// Parameters which can be set by name, see setParameter()
+static const struct {
+    const char * name;
+    double CaseFactory::* field;
+} doubleParameters[] = {
+    {"walls",                     &CaseFactory::walls},
+    {"floors",                    &CaseFactory::floors},
+    {"holesAddRadiusLoose",       &CaseFactory::holesAddRadiusLoose},
+    {"holesAddRadiusTight",       &CaseFactory::holesAddRadiusTight},
+    {"holesSize",                 &CaseFactory::holesSize},
+    {"holesWalls",                &CaseFactory::holesWalls},
+    {"holesFloors",               &CaseFactory::holesFloors},
+    {"space",                     &CaseFactory::space},
+    {"smallerBottomHeight",       &CaseFactory::smallerBottomHeight},
+    {"smallerTopHeight",          &CaseFactory::smallerTopHeight},
+    {"cornerRadius",              &CaseFactory::cornerRadius},
+    {"cornerFaces",               &CaseFactory::cornerFaces},
+    {"wallSupportMinSpan",        &CaseFactory::wallSupportMinSpan},
+    {"wallSupportInset",          &CaseFactory::wallSupportInset},
+    {"wallSupportMergeGap",       &CaseFactory::wallSupportMergeGap},
+    {"maxChordDeviation",         &CaseFactory::maxChordDeviation},
+    {"minFaceAngle",              &CaseFactory::minFaceAngle},
+    {"printLayerHeight",          &CaseFactory::printLayerHeight},
+    {"printSafeBridgeLayerCount", &CaseFactory::printSafeBridgeLayerCount},
+    {"printLineWidth",            &CaseFactory::printLineWidth},
+    {"printPerimeters",           &CaseFactory::printPerimeters},
+    {"printSolidLayers",          &CaseFactory::printSolidLayers},
+    {"printInfillDensity",        &CaseFactory::printInfillDensity},
+    {"printPerimeterSpeed",       &CaseFactory::printPerimeterSpeed},
+    {"printInfillSpeed",          &CaseFactory::printInfillSpeed},
+    {"printLayerTime",            &CaseFactory::printLayerTime},
+};
+
+static const struct {
+    const char * name;
+    bool CaseFactory::* field;
+} boolParameters[] = {
+    {"extrudedShell",  &CaseFactory::extrudedShell},
+    {"preview",        &CaseFactory::preview},
+    {"foldTransforms", &CaseFactory::foldTransforms},
+};
+
+static const struct {
+    const char * name;
+    CaseFactory::Side CaseFactory::* field;
+} sideParameters[] = {
+    {"screwHeadsOnSide",     &CaseFactory::screwHeadsOnSide},
+    {"outerExtensionOnSide", &CaseFactory::outerExtensionOnSide},
+};
+
+
+bool CaseFactory::setParameter(const std::string & name, const std::string & value)
+{
+    for (auto p : doubleParameters) {
+        if (name == p.name) {
+            char * end;
+            double d = std::strtod(value.c_str(), &end);
+            if (value.empty() || *end)
+                return false;
+            this->*p.field = d;
+            return true;
+        }
+    }
+    for (auto p : boolParameters) {
+        if (name == p.name) {
+            if (value == "true" || value == "1")       this->*p.field = true;
+            else if (value == "false" || value == "0") this->*p.field = false;
+            else return false;
+            return true;
+        }
+    }
+    for (auto p : sideParameters) {
+        if (name == p.name) {
+            if (value == "bottom")   this->*p.field = BottomSide;
+            else if (value == "top") this->*p.field = TopSide;
+            else return false;
+            return true;
+        }
+    }
+    if (name == "csgMode")
+        return parseCsgMode(value, csgMode);
+    return false;
+}
+
+
+std::vector<std::string> CaseFactory::parameterNames()
+{
+    std::vector<std::string> names;
+    for (auto p : doubleParameters)
+        names.push_back(p.name);
+    for (auto p : boolParameters)
+        names.push_back(p.name);
+    for (auto p : sideParameters)
+        names.push_back(p.name);
+    names.push_back("csgMode");
+    return names;
+}
+
+
+std::string CaseFactory::parameterValue(const std::string & name) const
+{
+    for (auto p : doubleParameters) {
+        if (name == p.name) {
+            // Enough digits to give the same double when read back
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.17g", this->*p.field);
+            return text;
+        }
+    }
+    for (auto p : boolParameters) {
+        if (name == p.name)
+            return (this->*p.field) ? "true" : "false";
+    }
+    for (auto p : sideParameters) {
+        if (name == p.name)
+            return (this->*p.field == BottomSide) ? "bottom" : "top";
+    }
+    if (name == "csgMode")
+        return csgModeName(csgMode);
+    return "";
+}
+
+
+Solid CaseFactory::constructPart(Side whichSide)
 {
     // Select parameters depending on which part to build
     auto innerHeight     = (whichSide == BottomSide) ? bottomInnerHeight()        : topInnerHeight();
     auto outerHeight     = (whichSide == BottomSide) ? bottomHeight()             : topHeight();
-    auto forbiddenAreas  = (whichSide == BottomSide) ? board.bottomForbiddenAreas          : board.topForbiddenAreas;
-    auto ports           = (whichSide == BottomSide) ? board.bottomPorts          : board.topPorts;
-    auto wallSupports    = (whichSide == BottomSide) ? board.bottomWallSupports   : board.topWallSupports;
+    auto & forbiddenAreas  = (whichSide == BottomSide) ? bottomCutAreas             : topCutAreas;
+    auto & ports           = (whichSide == BottomSide) ? board.bottomPorts          : board.topPorts;
+    auto wallSupports    = this->wallSupports(whichSide);
     auto extension       = (whichSide == outerExtensionOnSide) ? ExtensionOutside : ExtensionInside;
     auto screwHoleRadius =((whichSide == screwHeadsOnSide) ? holesAddRadiusLoose : holesAddRadiusTight) + board.holesRadius;
     auto screwHeads      = (whichSide == screwHeadsOnSide);
 
+    TraceScope trace("constructPart", whichSide == BottomSide ? "bottom" : "top");
+
+    // All nodes of the part from one arena, and equal primitives (like the cylinders of the screw holes) only once
+    SolidArena arena;
+
     // We start with the base
-    Component c = constructBase(innerHeight, extension);
+    Solid base = extrudedShell ? constructExtrudedBase(innerHeight, extension) : constructBase(innerHeight, extension);
+    CsgBuilder part(base, csgMode);
 
     // Add wall support
-    for (auto wallSupport : wallSupports) {
-        c = addWallSupport(c, outerHeight, wallSupport);
+    for (const auto & wallSupport : wallSupports) {
+        addWallSupport(part, outerHeight, wallSupport);
     }
 
-    // Screw holes
-    for (auto hole : board.holes) {
-        c = addHoleForScrew(c, outerHeight, hole, screwHoleRadius, screwHeads);
+    // Screw holes. Each one adds an enclosure and then cuts the hole. If an enclosure could fill the hole of
+    // a screw handled before, the holes have to be cut one after another to keep the geometry unchanged.
+    bool screwsOverlap = screwEnclosuresOverlapHoles(screwHoleRadius, screwHeads);
+    for (const auto & hole : board.holes) {
+        addHoleForScrew(part, outerHeight, hole, screwHoleRadius, screwHeads);
+        if (screwsOverlap)
+            part.flush();
     }
     
     // Added by: Anthony W. Rainer <pristine.source@gmail.com>
     if(whichSide == TopSide) {
 	// Screw holes Nuts
-        for (auto holeNut : board.holeNuts) {
-            c = addCavityForNut(c, outerHeight, board.holes[holeNut.holeIndex], holeNut);
+        for (const auto & holeNut : board.holeNuts) {
+            if (holeNut.holeIndex < 0 || holeNut.holeIndex >= int(board.holes.size()))
+                continue; // reported by checkCase
+            addCavityForNut(part, outerHeight, board.holes[holeNut.holeIndex], holeNut);
         }
     }
 
-    // Apply rounded corners (if enabled)
-    if (cornerRadius > 0.0) {
+    // Apply rounded corners (if enabled and not done by the extruded shell already)
+    if (cornerRadius > 0.0 && !extrudedShell && !preview) {
+        TraceScope roundingTrace("roundedCorners");
+
         // Class "RoundedCube" of ooml is buggy as it doesn't respect the "faces" parameter.
         // So we construct our own rounded cuboid by taking the convex hull of eight spheres.
         Vec min = {-outset(), -outset(), 0};
@@ -96,63 +726,204 @@ Component CaseFactory::constructPart(Side whichSide)
         Vec cornerOffset = {cornerRadius, cornerRadius, cornerRadius};
         min += cornerOffset;
         max -= cornerOffset;
-        CompositeComponent roundedCorners = Hull::create();
+        std::vector<Solid> spheres;
         for (int corner = 0; corner < 8; corner++) {
             double x = (corner & (1 << 0)) ? min.x : max.x;
             double y = (corner & (1 << 1)) ? min.y : max.y;
             double z = (corner & (1 << 2)) ? min.z : max.z;
-            roundedCorners.addComponent(Sphere(cornerRadius, cornerFaces).translatedCopy(x, y, z));
+            spheres.push_back(Solid::sphere(cornerRadius, faces(cornerRadius, cornerFaces)).translatedCopy(x, y, z));
         }
+        Solid roundedCorners = Solid::combine(Solid::HullKind, spheres);
 
         // Intersect the current part with the rounded cuboid
-        c = c * roundedCorners;
+        part.intersect(roundedCorners);
+        roundingTrace.setResult(roundedCorners);
     }
 
     // Port holes
-    for (auto port : ports) {
-        c = addHoleForPort(c, outerHeight, port);
+    for (const auto & port : ports) {
+        addHoleForPort(part, outerHeight, port);
     }
 
     // "Forbidden areas" of the board
-    for (auto area : forbiddenAreas) {
-        c = c - Cube(area.sx, area.sy, area.sz + extensionHeight() + eps, false)
-                .translatedCopy(area.x, area.y, outerHeight - area.sz);
+    for (const auto & area : forbiddenAreas) {
+        part.subtract(Solid::cube(area.sx, area.sy, area.sz + extensionHeight() + eps)
+                .translatedCopy(area.x, area.y, outerHeight - area.sz));
     }
 
+    Solid c = part.result();
+    culled[whichSide] = part.culledSubtractions();
+
     // If this is the top, we've just built it mirrored. So we mirror the y axis and move it so it matches the dimensions of the bottom part.
     if (whichSide == TopSide) {
         c.scale(1.0, -1.0, 1.0);
         c.translate(0.0, board.size[1], 0.0);
     }
 
+    if (foldTransforms)
+        c = canonicalCsg(c);
+
+    trace.setResult(c);
     return c;
 }
 
 
-Component CaseFactory::constructBase(double innerHeight, int extensionDirection)
+Solid CaseFactory::constructBase(double innerHeight, int extensionDirection)
 {
+    TraceScope trace("constructBase");
+
     // The walls and the floor are made by subtracting two cuboids.
-    Component base = Cube(board.size[0] + 2*outset(), board.size[1] + 2*outset(), innerHeight + floors, false)
+    Solid base = Solid::cube(board.size[0] + 2*outset(), board.size[1] + 2*outset(), innerHeight + floors)
             .translatedCopy(-outset(), -outset(), 0);
-    Component baseInner = Cube(board.size[0] + 2*space,  board.size[1] + 2*space,  innerHeight + eps, false)
+    Solid baseInner = Solid::cube(board.size[0] + 2*space,  board.size[1] + 2*space,  innerHeight + eps)
             .translatedCopy(-space, -space, floors);
     base = base - baseInner;
 
     // Extension (half width wall goes a bit higher, either the inner or the outer half depending on extensionDirection)
     double off_ext_outer = walls * (extensionDirection ? 1.00 : 0.45) + space;
     double off_ext_inner = walls * (extensionDirection ? 0.55 : 0.00) + space;
-    Component extension = Cube(board.size[0] + 2*off_ext_outer, board.size[1] + 2*off_ext_outer, extensionHeight() + eps, false)
+    Solid extension = Solid::cube(board.size[0] + 2*off_ext_outer, board.size[1] + 2*off_ext_outer, extensionHeight() + eps)
             .translatedCopy(-off_ext_outer, -off_ext_outer, innerHeight + floors - eps);
-    Component extensionInner = Cube(board.size[0] + 2*off_ext_inner, board.size[1] + 2*off_ext_inner, extensionHeight() + 3 * eps, false)
+    Solid extensionInner = Solid::cube(board.size[0] + 2*off_ext_inner, board.size[1] + 2*off_ext_inner, extensionHeight() + 3 * eps)
             .translatedCopy(-off_ext_inner, -off_ext_inner, innerHeight + floors - 2 * eps);
     extension = extension - extensionInner;
 
     // Combine both
-    return base + extension;
+    Solid result = base + extension;
+    trace.setResult(result);
+    return result;
+}
+
+
+Solid CaseFactory::constructExtrudedBase(double innerHeight, int extensionDirection)
+{
+    TraceScope trace("constructExtrudedBase");
+
+    // The outer shell. Its vertical edges are rounded by the outline, the bottom edges by spheres in the
+    // corners, which give the same shape as the rounded cuboid of constructPart in the height of the shell.
+    double bodyHeight = innerHeight + floors;
+    Solid body;
+    if (cornerRadius > 0.0 && !preview && bodyHeight > cornerRadius) {
+        std::vector<Solid> shell = {offsetOutline(outset(), cornerRadius, bodyHeight - cornerRadius)};
+        double x[2] = {-outset() + cornerRadius, board.size[0] + outset() - cornerRadius};
+        double y[2] = {-outset() + cornerRadius, board.size[1] + outset() - cornerRadius};
+        for (int corner = 0; corner < 4; corner++) {
+            shell.push_back(Solid::sphere(cornerRadius, faces(cornerRadius, cornerFaces))
+                    .translatedCopy(x[corner & 1], y[corner >> 1], cornerRadius));
+        }
+        body = Solid::combine(Solid::HullKind, shell);
+    } else {
+        body = offsetOutline(outset(), 0, bodyHeight);
+    }
+    Solid base = body - offsetOutline(space, floors, innerHeight + eps);
+
+    // Extension, as in constructBase
+    double off_ext_outer = walls * (extensionDirection ? 1.00 : 0.45) + space;
+    double off_ext_inner = walls * (extensionDirection ? 0.55 : 0.00) + space;
+    Solid extension = offsetOutline(off_ext_outer, innerHeight + floors - eps, extensionHeight() + eps)
+            - offsetOutline(off_ext_inner, innerHeight + floors - 2 * eps, extensionHeight() + 3 * eps);
+
+    Solid result = base + extension;
+    trace.setResult(result);
+    return result;
+}
+
+
+Solid CaseFactory::offsetOutline(double offset, double z, double height)
+{
+    double radius = preview ? 0.0 : std::max(cornerRadius - (outset() - offset), 0.0);
+    return Solid::roundedRect(board.size[0] + 2 * offset, board.size[1] + 2 * offset, height, radius,
+                              faces(radius, cornerFaces))
+            .translatedCopy(-offset, -offset, z);
+}
+
+
+// Gaps narrower than minSpan between the intervals (and towards begin and end). The intervals are swept in the
+// order of their starts, keeping the end of the covered range so far.
+static std::vector<std::pair<double, double>> narrowGaps(std::vector<std::pair<double, double>> intervals,
+                                                         double begin, double end, double minSpan)
+{
+    std::sort(intervals.begin(), intervals.end());
+    std::vector<std::pair<double, double>> gaps;
+    double covered = begin;
+    for (auto interval : intervals) {
+        if (interval.first > covered && interval.first - covered < minSpan)
+            gaps.push_back({covered, interval.first});
+        covered = std::max(covered, interval.second);
+    }
+    if (end > covered && end - covered < minSpan)
+        gaps.push_back({covered, end});
+    return gaps;
+}
+
+
+std::vector<WallSupportDescription> CaseFactory::wallSupports(Side whichSide)
+{
+    std::vector<WallSupportDescription> supports = (whichSide == BottomSide) ? board.bottomWallSupports : board.topWallSupports;
+    if (wallSupportMinSpan <= 0.0)
+        return supports;
+
+    auto & forbiddenAreas = (whichSide == BottomSide) ? board.bottomForbiddenAreas : board.topForbiddenAreas;
+    auto & ports          = (whichSide == BottomSide) ? board.bottomPorts          : board.topPorts;
+
+    for (::Side side : {North, East, South, West}) {
+        bool alongX = (side == North || side == South);
+        double length = board.size[alongX ? 0 : 1];
+
+        // What the wall along this side is cut by: port holes (as wide as their chamfer on the outside), and
+        // forbidden areas reaching into the wall. Areas which end at the board's border or within the space
+        // around it leave the wall whole; like subtractions overlapping a surface, reaching up to eps past its
+        // inner face doesn't count either.
+        std::vector<std::pair<double, double>> cuts;
+        for (const auto & port : ports) {
+            if (port.side != side || port.path.empty())
+                continue;
+            double r = port.radius + std::max(walls + space - port.outset, 0.0);
+            double uMin = HUGE_VAL, uMax = -HUGE_VAL;
+            for (Point p : port.path) {
+                uMin = std::min(uMin, p.x - r);
+                uMax = std::max(uMax, p.x + r);
+            }
+            cuts.push_back({uMin, uMax});
+        }
+        for (const auto & area : forbiddenAreas) {
+            double start = alongX ? area.y : area.x;
+            double size  = alongX ? area.sy : area.sx;
+            double face  = (side == North) ? board.size[1] + space : (side == East) ? board.size[0] + space : -space;
+            bool reaches = (side == North || side == East) ? start + size > face + eps : start < face - eps;
+            if (reaches)
+                cuts.push_back(alongX ? std::make_pair(area.x, area.x + area.sx) : std::make_pair(area.y, area.y + area.sy));
+        }
+        if (cuts.empty())
+            continue;
+
+        // Support the narrow pieces of the wall left between the cuts (within the cavity), merging close ones
+        std::vector<WallSupportDescription> sideSupports;
+        for (auto gap : narrowGaps(cuts, -outset(), length + outset(), wallSupportMinSpan)) {
+            double start = std::max(gap.first, -space);
+            double end = std::min(gap.second, length + space);
+            if (end <= start)
+                continue;
+            if (!sideSupports.empty() && start - (sideSupports.back().pos + sideSupports.back().size) <= wallSupportMergeGap) {
+                sideSupports.back().size = end - sideSupports.back().pos;
+                continue;
+            }
+            sideSupports.push_back({side, start, end - start, wallSupportInset});
+        }
+        supports.insert(supports.end(), sideSupports.begin(), sideSupports.end());
+    }
+    return supports;
+}
+
+
+void CaseFactory::addWallSupport(CsgBuilder & part, double supportHeight, const WallSupportDescription &wallSupport)
+{
+    TraceScope trace("addWallSupport");
+    part.add(this->wallSupport(supportHeight, wallSupport));
 }
 
 
-Component CaseFactory::addWallSupport(const Component &component, double supportHeight, const WallSupportDescription &wallSupport)
+Solid CaseFactory::wallSupport(double supportHeight, const WallSupportDescription &wallSupport)
 {
     bool inYDirection = wallSupport.side == East  || wallSupport.side == West;
     bool onOppositeX  = wallSupport.side == East;
@@ -169,46 +940,97 @@ Component CaseFactory::addWallSupport(const Component &component, double support
     }
 
     if (onOppositeX) xPos = board.size[0] - xPos - xSize;
-    if (onOppositeY) yPos = board.size[1] - xPos - ySize;
+    if (onOppositeY) yPos = board.size[1] - yPos - ySize;
 
 
-    Component support = Cube(xSize, ySize, supportHeight, false)
+    return Solid::cube(xSize, ySize, supportHeight)
             .translatedCopy(xPos, yPos, 0);
+}
+
+
+void CaseFactory::addHoleForScrew(CsgBuilder & part, double partOuterHeight, const Point & pos, double radius, bool screwHead)
+{
+    TraceScope trace("addHoleForScrew");
+    Solid add, subtract, headHole;
+    screwHole(partOuterHeight, pos, radius, screwHead, add, subtract, headHole);
 
-    return component + support;
+    // Combine them on the existing component
+    part.add(add);
+    part.subtract(subtract);
+    if (screwHead)
+        part.subtract(headHole);
 }
 
 
-Component CaseFactory::addHoleForScrew(const Component & component, double partOuterHeight, const Point & pos, double radius, bool screwHead)
+void CaseFactory::screwHole(double partOuterHeight, const Point & pos, double radius, bool screwHead,
+                            Solid & add, Solid & subtract, Solid & headHole)
 {
     // The radius of the screw head hole as well as the "radius" of the outer cuboid shaped enclosure for the screw.
     double ri = holesSize / 2.0;
     double ro = holesSize / 2.0 + holesWalls;
 
     // Add to component: Hole cuboid
-    Component add = Cube(ro*2, ro*2, partOuterHeight, false)
+    add = Solid::cube(ro*2, ro*2, partOuterHeight)
             .translatedCopy(pos.x - ro, pos.y - ro, 0);
 
     // Subtract from component: Hole itself and maybe (if this is the screw head side) also a cylindrical-shaped screw head hole)
     double holeStart;
     if (screwHead)
-        holeStart = (partOuterHeight - holesFloors) + (printLayerHeight * printSafeBridgeLayerCount);
+        holeStart = (partOuterHeight - holesFloors) + (preview ? 0.0 : printLayerHeight * printSafeBridgeLayerCount);
     else
         holeStart = floors;
-    Component subtract = Cylinder(radius, partOuterHeight - holeStart + eps, 32, false)
+    subtract = Solid::cylinder(radius, partOuterHeight - holeStart + eps, faces(radius, 32))
             .translatedCopy(pos.x, pos.y, holeStart);
     if (screwHead) {
-        Component headHole = Cylinder(ri, partOuterHeight - holesFloors + eps, 32, false)
+        headHole = Solid::cylinder(ri, partOuterHeight - holesFloors + eps, faces(ri, 32))
                 .translatedCopy(pos.x, pos.y, -eps);
-        subtract = subtract + headHole;
     }
+}
 
-    // Combine them on the existing component
-    return (component + add) - subtract;
+
+int CaseFactory::faces(double radius, int fixedFaces)
+{
+    // Enough to see where a hole is
+    if (preview)
+        return std::min(fixedFaces, 8);
+
+    if (maxChordDeviation <= 0.0)
+        return fixedFaces;
+
+    // A chord of a circle with radius r spanning the angle a deviates r * (1 - cos(a / 2)) from the circle
+    if (maxChordDeviation >= radius)
+        return 5;
+    int n = std::max(5.0, std::ceil(M_PI / std::acos(1.0 - maxChordDeviation / radius)));
+    if (minFaceAngle > 0.0)
+        n = std::min(n, std::max(5, int(std::ceil(360.0 / minFaceAngle))));
+    return n;
+}
+
+
+bool CaseFactory::screwEnclosuresOverlapHoles(double radius, bool screwHead)
+{
+    // Same sizes as in addHoleForScrew. Compare the square enclosures with the bounding squares of the holes.
+    double ro = holesSize / 2.0 + holesWalls;
+    double rh = screwHead ? std::max(radius, holesSize / 2.0) : radius;
+    for (size_t i = 0; i < board.holes.size(); i++) {
+        for (size_t j = i + 1; j < board.holes.size(); j++) {
+            if (std::abs(board.holes[i].x - board.holes[j].x) < ro + rh &&
+                std::abs(board.holes[i].y - board.holes[j].y) < ro + rh)
+                return true;
+        }
+    }
+    return false;
 }
 
 // Added by: Anthony W. Rainer <pristine.source@gmail.com>
-Component CaseFactory::addCavityForNut(const Component & component, double partOuterHeight, const Point & pos, HoleNutDescription holeNut )
+void CaseFactory::addCavityForNut(CsgBuilder & part, double partOuterHeight, const Point & pos, const HoleNutDescription & holeNut)
+{
+    TraceScope trace("addCavityForNut");
+    part.subtract(nutCavity(pos, holeNut));
+}
+
+
+Solid CaseFactory::nutCavity(const Point & pos, const HoleNutDescription & holeNut)
 {
     // The "radius" of the outer cuboid shaped enclosure for the screw.
     double ro = holesSize / 2.0 + holesWalls;
@@ -243,14 +1065,23 @@ Component CaseFactory::addCavityForNut(const Component & component, double partO
     }
 
     // Subtract from component: nut cavity cuboid
-    Component subtract = Cube(holeNut.nutWidth+sx_adj, holeNut.nutWidth+sy_adj, holeNut.nutThickness, false)
+    return Solid::cube(holeNut.nutWidth+sx_adj, holeNut.nutWidth+sy_adj, holeNut.nutThickness)
             .translatedCopy((pos.x - ro)+posx_adj, (pos.y - ro)+posy_adj, holeNut.nutCavityHeightFromBottom);
+}
+
 
-    return component - subtract;
+void CaseFactory::addHoleForPort(CsgBuilder & part, double partOuterHeight, const PortDescription & port)
+{
+    TraceScope trace("addHoleForPort");
+    Solid hole, chamfer;
+    portHole(partOuterHeight, port, hole, chamfer);
+    part.subtract(hole);
+    if (!preview)
+        part.subtract(chamfer);
 }
 
 
-Component CaseFactory::addHoleForPort(const Component & component, double partOuterHeight, const PortDescription & port)
+void CaseFactory::portHole(double partOuterHeight, const PortDescription & port, Solid & hole, Solid & chamfer)
 {
     double off_xy = walls + space;
 
@@ -264,49 +1095,83 @@ Component CaseFactory::addHoleForPort(const Component & component, double partOu
     if (port.side == North) { base.y = board.size[1]; }
     if (port.side == East)  { base.x = board.size[0]; }
 
-    // The hole is a hull of translated cylinders, so the hole is a rounded shape with radius port.radius along port.path [If the radius is 0, we use a tiny cylinder with 4 faces]
-    Component cyl = Cylinder(std::max(port.radius, .001), off_xy + 2 * eps, port.radius == 0 ? 4 : 32, false);
-    cyl.translate(0, 0, -eps);
-    
     // Added by: Anthony W. Rainer <pristine.source@gmail.com>
-    if(port.side != Flat) {
-	cyl.rotateEulerZXZ(0.0, -90.0, -90.0 * port.side);
-    }else{
-	cyl.rotateEulerZXZ(0.0, 180.0, 0);
+    // Ports on the flat side go through the floor, the others through their wall. The hole is built along the
+    // z axis and rotated (by theta, psi) so that z points through it.
+    if (port.side == Flat)
+        base = {0, 0, off_xy};
+    double theta = (port.side != Flat) ? -90.0 : 180.0;
+    double psi   = (port.side != Flat) ? -90.0 * port.side : 0.0;
+
+    std::vector<Vec> points;
+    for (auto localPoint : port.path)
+        points.push_back((port.side != Flat) ? base + localPoint.x*u + localPoint.y*v
+                                             : Vec{localPoint.x, localPoint.y, off_xy});
+
+    // The same points in the plane of the hole (x and y of the rotated frame)
+    Matrix rotation = Matrix::rotationZ(psi) * Matrix::rotationX(theta);
+    Vec ex = rotation * Vec{1, 0, 0}, ey = rotation * Vec{0, 1, 0};
+    Box plane;
+    for (const Vec & p : points)
+        plane.extend(Vec{dot(p - base, ex), dot(p - base, ey), 0});
+
+    double radius = std::max(port.radius, .001);
+    int holeFaces = port.radius == 0 ? 4 : faces(port.radius, 32);
+    double coneLength = off_xy - port.outset;
+    double coneRadius = port.radius + coneLength + 2 * eps;
+
+    // Usually, the path is a rectangle in that plane (or a line or a point). Then the hole, the path offset by
+    // the radius, is a rounded rectangle extruded through the wall, and the chamfer is the hull of two thin
+    // slabs of the path's outline: offset by the radius at the inner end and by coneRadius at the outer one.
+    // That is the same shape as the hull of the cones below, with one primitive per end instead of per point.
+    bool rectangle = true;
+    for (int corner = 0; corner < 4 && rectangle; corner++) {
+        Vec c = {(corner & 1) ? plane.max.x : plane.min.x, (corner & 2) ? plane.max.y : plane.min.y, 0};
+        rectangle = std::any_of(points.begin(), points.end(), [&](const Vec & p) {
+            return std::abs(dot(p - base, ex) - c.x) < 1e-9 && std::abs(dot(p - base, ey) - c.y) < 1e-9;
+        });
     }
+    if (rectangle) {
+        double sx = plane.max.x - plane.min.x + 2 * radius;
+        double sy = plane.max.y - plane.min.y + 2 * radius;
+        hole = Solid::roundedRect(sx, sy, off_xy + 2 * eps, radius, holeFaces);
+        hole.translate(plane.min.x - radius, plane.min.y - radius, -eps);
+        hole.rotateEulerZXZ(0.0, theta, psi);
+        hole.translate(base.x, base.y, base.z);
+
+        chamfer = Solid();
+        if (!preview) {
+            double slab = (coneLength + 2 * eps) / 1000;
+            double growth = coneRadius - radius;
+            Solid inner = Solid::roundedRect(sx, sy, slab, radius, faces(coneRadius, 32));
+            inner.translate(plane.min.x - radius, plane.min.y - radius, port.outset);
+            Solid outer = Solid::roundedRect(sx + 2 * growth, sy + 2 * growth, slab, coneRadius, faces(coneRadius, 32));
+            outer.translate(plane.min.x - coneRadius, plane.min.y - coneRadius, port.outset + coneLength + 2 * eps - slab);
+            chamfer = Solid::combine(Solid::HullKind, {inner, outer});
+            chamfer.rotateEulerZXZ(0.0, theta, psi);
+            chamfer.translate(base.x, base.y, base.z);
+        }
+        return;
+    }
+
+    // Otherwise the hole is a hull of translated cylinders, so the hole is a rounded shape with radius port.radius along port.path [If the radius is 0, we use a tiny cylinder with 4 faces]
+    Solid cyl = Solid::cylinder(radius, off_xy + 2 * eps, holeFaces);
+    cyl.translate(0, 0, -eps);
+    cyl.rotateEulerZXZ(0.0, theta, psi);
 
     // Add a cone for diagonal borders of the port hole
-    double coneLength = off_xy - port.outset;
-    Component cone = Cylinder(port.radius, port.radius + coneLength + 2 * eps, coneLength + 2 * eps, 32, false);
+    Solid cone = Solid::cone(port.radius, coneRadius, coneLength + 2 * eps, faces(coneRadius, 32));
     cone.translate(0, 0, port.outset);
-    
-    // Added by: Anthony W. Rainer <pristine.source@gmail.com>
-    if(port.side != Flat) {
-	cone.rotateEulerZXZ(0.0, -90.0, -90.0 * port.side);
-    }else{
-	cone.rotateEulerZXZ(0.0, 180.0, 0);
-    }
+    cone.rotateEulerZXZ(0.0, theta, psi);
 
     // Build convex hull of translated copies of this cylinder along the path of the port
-    CompositeComponent cylHull = Hull::create();
-    CompositeComponent coneHull = Hull::create();
-    for (auto localPoint : port.path)
+    std::vector<Solid> cyls;
+    std::vector<Solid> cones;
+    for (const Vec & p : points)
     {
-        Vec p;
-	    
-	// Added by: Anthony W. Rainer <pristine.source@gmail.com>
-	if(port.side != Flat) {
-		p = base + localPoint.x*u + localPoint.y*v;
-	} else {
-		p.z = off_xy;
-		p.x = localPoint.x;
-		p.y = localPoint.y;
-	}
-        Component thisCyl = cyl.translatedCopy(p.x, p.y, p.z);
-	cylHull.addComponent(thisCyl);
-	
-	Component thisCone = cone.translatedCopy(p.x, p.y, p.z);
-	coneHull.addComponent(thisCone);
-    }
-    return component - (cylHull + coneHull);
+        cyls.push_back(cyl.translatedCopy(p.x, p.y, p.z));
+        cones.push_back(cone.translatedCopy(p.x, p.y, p.z));
+    }
+    hole = Solid::combine(Solid::HullKind, cyls);
+    chamfer = preview ? Solid() : Solid::combine(Solid::HullKind, cones);
 }
@@ -2,10 +2,10 @@
 #define CASEFACTORY_H
 
 #include <ooml/components.h>
-#include <ooml/core/Hull.h>
-#include <ooml/core/Intersection.h>
 #include "geom.h"
 #include "boarddescription.h"
+#include "csgbuilder.h"
+#include "solid.h"
 
 
 // Small epsilon value for building differences where positive and negative parts have (partly) common faces.
@@ -15,6 +15,64 @@ static const double eps = .1;
 
 
 
+// Closed-form measures of a case, see CaseFactory::measure()
+struct CaseMeasures {
+    Vec outer;              // outer dimensions of the assembled case
+    double material;        // volume of both parts, mm^3
+    double thinnestWall;    // at the rounded corners, and beside and above the port holes
+    double thinnestFloor;   // beneath the forbidden areas which reach into the floor
+};
+
+
+
+// Closed-form estimates for one part of a case, see CaseFactory::estimatePart()
+struct PartEstimate {
+    double volume = 0;         // mm^3
+    double verticalArea = 0;   // mm^2, walls and holes, printed as perimeters
+    double horizontalArea = 0; // mm^2, floor and rim, printed as solid layers
+    double height = 0;         // mm, in print orientation
+    double printTime = 0;      // s
+
+    double surfaceArea() const { return verticalArea + horizontalArea; }
+};
+
+
+
+// A feature of one part of a case, see CaseFactory::layout()
+struct CaseFeature {
+    enum Kind {
+        ScrewEnclosure,
+        ScrewHole,
+        ScrewHeadHole,
+        NutCavity,
+        WallSupport,
+        PortHole,
+        PortChamfer,
+        ForbiddenArea
+    };
+
+    Kind kind;
+    int index; // of the hole, hole nut, port, wall support or forbidden area in the board description
+    Box bounds;
+
+    // Round features are prisms along one axis (0 = x, 1 = y, 2 = z) within the bounds: the convex hull of the
+    // profile points (on the other two axes, in order) grown by radius. -1 = the feature is its bounds.
+    int axis = -1;
+    std::vector<Point> profile;
+    double radius = 0;
+
+    bool additive() const { return kind == ScrewEnclosure || kind == WallSupport; }
+};
+
+// Where the features of one part are, see CaseFactory::layout()
+struct PartLayout {
+    Box outer;  // outer shell (without the extension and the rounded corners)
+    Box cavity; // open towards max z, where the board is
+    std::vector<CaseFeature> features;
+};
+
+
+
 struct CaseFactory
 {
     enum Side {
@@ -35,9 +93,62 @@ struct CaseFactory
     //! Generate the top part of the case.
     Component constructTop();
 
+    //! Same as above, but as backend independent CSG tree (which can also be
+    //! evaluated to a mesh, see mesh.h).
+    Solid constructBottomSolid();
+    Solid constructTopSolid();
+
     //! Calculate the total outer dimensions of the assembled case.
     Vec outerDimensions();
 
+    //! Number of forbidden areas of the board which constructPart leaves out
+    //! because they are covered by others or were merged with others (see
+    //! forbiddenareas.h). Each one saves a boolean operation. Everything
+    //! else, like layout(), refers to the areas as given by the board.
+    int coalescedForbiddenAreas() const { return coalescedAreas; }
+
+    //! Number of subtractions left out of the last constructed part of the
+    //! given side because they would only cut air (see CsgBuilder).
+    int culledSubtractions(Side side) const { return culled[side]; }
+
+    //! Measure the case for the current parameters from closed-form
+    //! expressions, without constructing any geometry. This is fast enough
+    //! to compare thousands of parameter sets (see optimizer.h). The
+    //! material volume is an estimate: it ignores the port cones and
+    //! the overlaps between features, and approximates the rounded
+    //! corners by their edges. Ports reaching past the end of their side
+    //! are meant to be open to the corner and don't count as walls.
+    CaseMeasures measure();
+
+    //! Estimate the material, surface and print time of one part, for
+    //! planning print queues without rendering. Starts from the same
+    //! expressions, and corrects them for the overlaps of the features with
+    //! each other and with the walls and floor, from the boxes and prisms of
+    //! layout() (inclusion-exclusion up to pairs, and triples within the
+    //! screw enclosures and wall supports). The print time
+    //! follows from the print parameters below: every vertical surface is
+    //! traced by printPerimeters lines in each layer, flat surfaces get
+    //! printSolidLayers solid layers and the rest is infill.
+    PartEstimate estimatePart(Side side);
+
+    //! Where the shell and the features of one part are, as boxes and prisms
+    //! in the coordinates the part is constructed in (x and y as on the board,
+    //! z = 0 at the outer floor, the top part not yet mirrored). For checking
+    //! the board description without constructing the part (see clearance.h).
+    PartLayout layout(Side side);
+
+    //! Set one of the parameters below by its name, e.g. ("walls", "2.5") or
+    //! ("screwHeadsOnSide", "top"). Returns false for unknown names or
+    //! invalid values.
+    bool setParameter(const std::string & name, const std::string & value);
+
+    //! Names of all parameters accepted by setParameter().
+    static std::vector<std::string> parameterNames();
+
+    //! Current value of a parameter, in the format accepted by
+    //! setParameter(). Empty for unknown names.
+    std::string parameterValue(const std::string & name) const;
+
 
 
 
@@ -65,11 +176,47 @@ struct CaseFactory
     double cornerRadius = 2;
     double cornerFaces = 20; // should be >= 16.
 
+    // Automatic wall supports: wherever the wall along a side is cut into pieces narrower than wallSupportMinSpan
+    // (by port holes, forbidden areas reaching the board's border and the corners), a wall support reaching
+    // wallSupportInset into the case is added to those of the board. Supports at most wallSupportMergeGap apart
+    // become one, which also fills the gap between them (only merge across ports whose connectors are
+    // forbidden areas, otherwise the support closes the port). 0 = no automatic supports.
+    double wallSupportMinSpan = 0.0;
+    double wallSupportInset = 2.0;
+    double wallSupportMergeGap = 0.0;
+
+    // How to build the walls, floor and lip. false: by subtracting cuboids, then the whole part is intersected
+    // with a rounded cuboid (hull of spheres) after all features are added. true: as extrusions of rounded
+    // rectangles, each a 2D offset of the outer outline, and only the outer shell is rounded in 3D. This puts
+    // the most expensive boolean on the simplest operand. Features reaching out of the case aren't clipped.
+    bool extrudedShell = false;
+
+    // Tessellation of round shapes (screw and port holes, corners). With maxChordDeviation > 0, each cylinder,
+    // cone and sphere gets as few faces as keep its polygon within maxChordDeviation of the true circle, but
+    // at most one face per minFaceAngle degrees (and at least 5). With 0, the fixed counts are used (32 faces
+    // for holes, cornerFaces for corners).
+    double maxChordDeviation = 0.0;
+    double minFaceAngle = 4.0;
+
+    // Preview quality, to check the position of the ports and the fit of the board quickly: no rounded corners,
+    // port holes without chamfers, at most 8 faces per round shape and no safe bridges (see below). The outer
+    // dimensions stay the same. OpenSCAD renders such a part in about a second.
+    bool preview = false;
+
+    // Brings the finished CSG tree of each part into canonical form (see canonicalCsg): one transformation per
+    // primitive, the mirror of the top part absorbed into the primitives, and no booleans of empty or single
+    // operands. The same geometry in fewer nodes.
+    bool foldTransforms = true;
+
 
     // what to build on which side (the contrary part is on the other side)
     Side screwHeadsOnSide = BottomSide;
     Side outerExtensionOnSide = BottomSide;
 
+    // How the features are combined into the CSG tree (see CsgMode). All modes give the same geometry, but
+    // OpenSCAD / CGAL renders the flat trees much faster than the original sequential one.
+    CsgMode csgMode = FlatCsg;
+
 
 
     // 3D PRINTING PARAMETERS - CHANGE THEM TO YOUR NEEDS BEFORE GENERATING ANY COMPONENTS.
@@ -84,6 +231,17 @@ struct CaseFactory
     // If your printer has problems printing bridges, set this value to 2 or even 3.
     double printSafeBridgeLayerCount = 1;
 
+    // Slicer settings and speeds of the printer, only used for print time estimates (see estimatePart()).
+    // Lengths in mm, speeds in mm/s; printLayerTime is the time spent per layer besides extruding (travel,
+    // retraction, z moves).
+    double printLineWidth = .45;
+    double printPerimeters = 2;
+    double printSolidLayers = 4;
+    double printInfillDensity = .2;
+    double printPerimeterSpeed = 40;
+    double printInfillSpeed = 60;
+    double printLayerTime = 1.5;
+
 
 
 
@@ -99,6 +257,14 @@ private:
     // Calculated in the constructor after the board is known
     double boardBottomInnerHeight;
     double boardTopInnerHeight;
+    int coalescedAreas;
+
+    // The forbidden areas of the board after coalescing, as cut out by constructPart
+    std::vector<ForbiddenAreaDescription> bottomCutAreas;
+    std::vector<ForbiddenAreaDescription> topCutAreas;
+
+    // Set by constructPart, per side as both sides may be constructed in parallel
+    int culled[2] = {0, 0};
 
 
     // Inner height of the case (measured from board's surface to inner surface of the case)
@@ -121,18 +287,42 @@ private:
     inline double outerDepth() { return board.size[1] + 2 * outset(); }
 
     // Puts all things together required to build one part of the case (top / bottom)
-    Component constructPart(Side whichSide);
+    Solid constructPart(Side whichSide);
 
     // Wall extension: 0 = on the inner half of the wall, 1 = on the outer half of the wall
-    Component constructBase(double innerHeight, int extensionDirection);
+    Solid constructBase(double innerHeight, int extensionDirection);
+    Solid constructExtrudedBase(double innerHeight, int extensionDirection);
+
+    // Extruded rectangle of the board size plus offset on each side, with its corners rounded like the
+    // outer corners offset by offset - outset() (see extrudedShell)
+    Solid offsetOutline(double offset, double z, double height);
+
+    // The wall supports of the board and the automatic ones (see wallSupportMinSpan)
+    std::vector<WallSupportDescription> wallSupports(Side whichSide);
+
+    void addWallSupport(CsgBuilder & part, double supportHeight, const WallSupportDescription & wallSupport);
+    void addHoleForScrew(CsgBuilder & part, double partOuterHeight, const Point & pos, double radius, bool screwHead);
+    void addHoleForPort(CsgBuilder & part, double partOuterHeight, const PortDescription & port);
+
+    // The solids added or subtracted by the functions above (and by addCavityForNut), also used by layout()
+    Solid wallSupport(double supportHeight, const WallSupportDescription & wallSupport);
+    void screwHole(double partOuterHeight, const Point & pos, double radius, bool screwHead,
+                   Solid & enclosure, Solid & hole, Solid & headHole);
+    void portHole(double partOuterHeight, const PortDescription & port, Solid & hole, Solid & chamfer);
+    Solid nutCavity(const Point & pos, const HoleNutDescription & holeNut);
+
+    // Estimated volume and surfaces of one part and its thinnest wall and floor (see measure())
+    PartEstimate measurePart(Side whichSide, double & thinnestWall, double & thinnestFloor);
+
+    // Number of faces for a round shape with the given radius (see maxChordDeviation)
+    int faces(double radius, int fixedFaces);
 
-    Component addWallSupport(const Component & component, double supportHeight, const WallSupportDescription & wallSupport);
-    Component addHoleForScrew(const Component & component, double partOuterHeight, const Point & pos, double radius, bool screwHead);
-    Component addHoleForPort(const Component & component, double partOuterHeight, const PortDescription & port);
+    // Whether the enclosure of one screw hole can reach into the hole of another one (see constructPart)
+    bool screwEnclosuresOverlapHoles(double radius, bool screwHead);
     
     
     // Added by: Anthony W. Rainer <pristine.source@gmail.com>
-    Component addCavityForNut(const Component & component, double partOuterHeight, const Point & pos, HoleNutDescription holeNut );
+    void addCavityForNut(CsgBuilder & part, double partOuterHeight, const Point & pos, const HoleNutDescription & holeNut);
 };
 
 
@@ -0,0 +1,812 @@
+#include "casejob.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <poll.h>
+#include <sstream>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "casefactory.h"
+#include "boardfile.h"
+#include "mesh.h"
+#include "meshexport.h"
+#include "partcache.h"
+#include "platepacker.h"
+#include "scadwriter.h"
+#include "trace.h"
+
+
+
+typedef std::chrono::steady_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+// Durations of the stages of a job, in the order they were started.
+struct StageTimes {
+    std::vector<std::pair<std::string, double>> stages; // name, ms
+
+    void add(const std::string & name, double ms) { stages.push_back({name, ms}); }
+    void add(const StageTimes & other) { stages.insert(stages.end(), other.stages.begin(), other.stages.end()); }
+};
+
+
+// Prints the time of each stage and the total wall time of the job.
+static void printTimes(std::ostream & log, const StageTimes & times, double total)
+{
+    std::streamsize precision = log.precision();
+    log << "Timing:" << std::fixed << std::setprecision(2);
+    for (auto stage : times.stages)
+        log << " " << stage.first << " " << stage.second << " ms,";
+    log << " total " << total << " ms" << std::endl;
+    log.unsetf(std::ios::floatfield);
+    log.precision(precision);
+}
+
+
+// Small helper function which streams the model to a file in SCAD format.
+static bool write(std::ostream & log, std::string fileName, const Solid & model, bool sharedModules,
+                  CsgStats & stats)
+{
+    log << "Writing file " << fileName << " ... ";
+
+    TraceScope trace("write", fileName);
+    Clock::time_point start = Clock::now();
+    ScadWriter writer(fileName);
+    if (sharedModules)
+        writer.declareModules({model});
+    writer.write(model);
+    bool ok = writer.close();
+    stats = writer.stats();
+    trace.setResult(model);
+    trace.setBytes(stats.bytes);
+
+    log << (ok ? "done" : "FAILED") << " (" << stats.bytes << " bytes, "
+        << std::fixed << std::setprecision(1) << stats.bytes / 1e3 / millisecondsSince(start) << " MB/s)" << std::endl;
+    log.unsetf(std::ios::floatfield);
+    return ok;
+}
+
+
+// Where the top part goes in the combined file, next to the bottom part
+static double combinedOffset(CaseFactory & factory)
+{
+    double distance = 5; // mm
+    return factory.outerDimensions().y + distance;
+}
+
+
+// Writes both parts side by side. This is the same as bottom + top.translatedCopy(0, offset, 0), but streams
+// both trees into one file without building that combined tree.
+static bool writeCombined(std::ostream & log, const std::string & fileName, const Solid & bottom, const Solid & top,
+                          double offset, bool sharedModules)
+{
+    log << "Writing file " << fileName << " ... ";
+    TraceScope trace("writeCombined", fileName);
+    ScadWriter combined(fileName);
+    if (sharedModules)
+        combined.declareModules({bottom, top});
+    combined.begin("union()");
+    combined.write(bottom);
+    std::ostringstream translate;
+    translate << std::setprecision(15) << "translate([0, " << offset << ", 0])";
+    combined.begin(translate.str());
+    combined.write(top);
+    combined.end();
+    combined.end();
+    bool written = combined.close();
+    trace.setBytes(combined.stats().bytes);
+    log << (written ? "done" : "FAILED") << " (" << combined.stats().bytes << " bytes)" << std::endl;
+    return written;
+}
+
+
+// Version of the generated output, part of the cache keys. Increase it in every commit which changes the
+// output for the same board and parameters, so no outdated parts are taken from caches. The output is all
+// cached files: the SCAD text and the STL and 3MF meshes, so changes to the mesh backend count as well.
+static const char * generatorVersion = "18";
+
+// Everything one part depends on besides the parameters: the board without the features of the other side,
+// and the total height of the case (the rounded corners span both parts).
+static std::string partSignature(BoardDescription board, CaseFactory & factory, CaseFactory::Side side)
+{
+    if (side == CaseFactory::BottomSide) {
+        board.topForbiddenAreas.clear();
+        board.topHoles.clear();
+        board.topPorts.clear();
+        board.topWallSupports.clear();
+        board.holeNuts.clear();
+    } else {
+        board.bottomForbiddenAreas.clear();
+        board.bottomPorts.clear();
+        board.bottomWallSupports.clear();
+    }
+    std::ostringstream text;
+    writeBoard(text, board);
+    Vec outer = factory.outerDimensions();
+    text << std::setprecision(17) << outer.x << " " << outer.y << " " << outer.z << std::endl;
+    return text.str();
+}
+
+
+// Hash of everything the generated file of one part depends on. Each part has its own key, so a change to the
+// features of one side still takes the other part from the cache.
+static std::string cacheKey(const BoardDescription & board, CaseFactory & factory, const CaseJob & job,
+                            CaseFactory::Side side)
+{
+    std::ostringstream text;
+    text << "casefactory " << generatorVersion << std::endl;
+    text << partSignature(board, factory, side);
+    for (auto name : CaseFactory::parameterNames())
+        text << name << "=" << factory.parameterValue(name) << std::endl;
+    text << "sharedModules=" << job.sharedModules << std::endl;
+    return hashText(text.str());
+}
+
+
+// One part of the case, constructed and written to its file.
+struct PartOutput {
+    Solid solid;
+    CsgStats stats;
+    std::string log;
+    StageTimes times;
+    bool written;
+    bool cached = false; // taken from the cache, solid not constructed
+    std::string error;   // why the part wasn't written, if not just a failed write
+};
+
+static PartOutput buildPart(const CaseJob & job, CaseFactory & factory, CaseFactory::Side side, const std::string & filePrefix,
+                            const std::string & key)
+{
+    std::string name = (side == CaseFactory::BottomSide) ? "bottom" : "top";
+    std::string fileName = filePrefix + "-case-" + name;
+    PartOutput part;
+
+    Clock::time_point start = Clock::now();
+    PartCache::Files files = {{key + "-" + name + ".scad", fileName + ".scad"}};
+    if (job.stl)
+        files.push_back({key + "-" + name + ".stl", fileName + ".stl"});
+    if (job.threeMf)
+        files.push_back({key + "-" + name + ".3mf", fileName + ".3mf"});
+    if (job.cache && job.cache->fetch(files)) {
+        part.cached = true;
+        part.written = true;
+        part.log = "Using cached " + fileName + ".scad\n";
+        part.times.add("cached " + name, millisecondsSince(start));
+        return part;
+    }
+
+    start = Clock::now();
+    part.solid = (side == CaseFactory::BottomSide) ? factory.constructBottomSolid() : factory.constructTopSolid();
+    part.times.add("construct " + name, millisecondsSince(start));
+
+    start = Clock::now();
+    std::ostringstream log;
+    part.written = write(log, fileName + ".scad", part.solid, job.sharedModules, part.stats);
+    part.stats.facets = part.solid.primitiveFacets();
+    part.times.add("write " + name, millisecondsSince(start));
+
+    if (job.stl || job.threeMf) {
+        start = Clock::now();
+        TriangleMesh mesh;
+        {
+            TraceScope trace("evaluateMesh", name);
+            mesh = triangulate(evaluateMesh(part.solid, job.parallelMesh ? 0 : 1));
+        }
+        part.times.add("mesh " + name, millisecondsSince(start));
+        log << "Mesh of " << name << ": " << mesh.triangles.size() << " triangles" << std::endl;
+
+        // A mesh with holes isn't printable, so rather write no mesh file than a broken one
+        size_t open = openEdges(mesh);
+        if (open) {
+            part.error = "the mesh of " + fileName + " is not closed (" + std::to_string(open) + " open edges)";
+            part.written = false;
+        }
+
+        start = Clock::now();
+        if (job.stl && !open) {
+            log << "Writing file " << fileName << ".stl ... ";
+            bool ok = writeStl(fileName + ".stl", mesh);
+            log << (ok ? "done" : "FAILED") << std::endl;
+            part.written = part.written && ok;
+        }
+        if (job.threeMf && !open) {
+            log << "Writing file " << fileName << ".3mf ... ";
+            bool ok = write3mf(fileName + ".3mf", mesh);
+            log << (ok ? "done" : "FAILED") << std::endl;
+            part.written = part.written && ok;
+        }
+        part.times.add("write mesh " + name, millisecondsSince(start));
+    }
+
+    if (job.cache && part.written)
+        job.cache->store(files);
+
+    part.log = log.str();
+    return part;
+}
+
+
+// Prints the size of a generated CSG tree.
+static void report(std::ostream & log, std::string partName, const PartOutput & part)
+{
+    if (part.cached) {
+        log << partName << ": cached" << std::endl;
+        return;
+    }
+    const CsgStats & stats = part.stats;
+    log << partName << ": " << stats.nodes << " CSG nodes, "
+        << stats.booleans << " booleans, boolean depth " << stats.depth << ", "
+        << stats.facets << " primitive facets" << std::endl;
+}
+
+
+// Prints the material and print time estimates of both parts.
+static void printEstimates(std::ostream & log, CaseFactory & factory)
+{
+    log << "Estimate (" << factory.printLayerHeight << " mm layers):" << std::endl;
+    for (auto side : {CaseFactory::BottomSide, CaseFactory::TopSide}) {
+        PartEstimate part = factory.estimatePart(side);
+        int minutes = std::lround(part.printTime / 60);
+        log << ((side == CaseFactory::BottomSide) ? "  bottom: " : "  top: ")
+            << std::fixed << std::setprecision(1) << part.volume / 1e3 << " cm3, "
+            << part.surfaceArea() / 1e2 << " cm2, print time " << minutes / 60 << ":"
+            << std::setw(2) << std::setfill('0') << minutes % 60 << std::setfill(' ') << " h" << std::endl;
+        log.unsetf(std::ios::floatfield);
+    }
+}
+
+
+// Like "mkdir -p"
+static bool makeDirectories(const std::string & path)
+{
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        std::string dir = path.substr(0, slash);
+        if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+            return false;
+        if (slash == std::string::npos)
+            return true;
+    }
+}
+
+
+// File name without directory and extension
+static std::string baseName(const std::string & fileName)
+{
+    std::string base = fileName.substr(fileName.find_last_of('/') + 1);
+    return base.substr(0, base.find('.'));
+}
+
+
+
+bool configureFactory(CaseFactory & factory, const ParameterList & parameters, std::string & error)
+{
+    // Now we can fine-tune some dimension parameters for the case model. See the class CaseFactory for more options, such as wall thickness, screw hole radius etc.
+    factory.smallerBottomHeight = .5; // We want the bottom part to be a bit less high (so the GPIO pin ends will be within the floor; this is just to demonstrate the power of the feature "forbidden areas")
+
+    // You can set some print settings which will help the factory to optimize print results.
+    factory.printLayerHeight = .2;
+    factory.printSafeBridgeLayerCount = 3;
+
+    // Overrides from the command line or manifest
+    for (auto parameter : parameters) {
+        if (!factory.setParameter(parameter.first, parameter.second)) {
+            error = "invalid parameter " + parameter.first + "=" + parameter.second;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Generates the case with the factory as configured and writes the files <prefix>-case*.scad
+static bool writeCase(const CaseJob & job, const BoardDescription & board, CaseFactory & factory,
+                      const std::string & prefix, std::ostream & log, std::string & error)
+{
+    // Generate the models and write them to SCAD files. We generate 3 files.
+    // 1) Only the bottom and 2) only the top, each written to its file as soon as it is ready. Building both
+    //    parts on two threads made the whole job slower: constructing and writing a part takes about a
+    //    millisecond, less than starting the threads. Only meshing takes long enough, and it is parallel itself.
+    Clock::time_point start = Clock::now();
+    std::string bottomKey = job.cache ? cacheKey(board, factory, job, CaseFactory::BottomSide) : "";
+    std::string topKey = job.cache ? cacheKey(board, factory, job, CaseFactory::TopSide) : "";
+    PartOutput bottom = buildPart(job, factory, CaseFactory::BottomSide, prefix, bottomKey);
+    PartOutput top = buildPart(job, factory, CaseFactory::TopSide, prefix, topKey);
+
+    log << "CSG tree (" << csgModeName(factory.csgMode) << " mode" << (factory.preview ? ", preview" : "") << "):" << std::endl;
+    report(log, "  bottom", bottom);
+    report(log, "  top", top);
+    if (!bottom.cached && !top.cached) {
+        log << "  facet budget: " << bottom.stats.facets + top.stats.facets << " primitive facets in total";
+        if (factory.maxChordDeviation > 0)
+            log << " (max chord deviation " << factory.maxChordDeviation << " mm, min face angle " << factory.minFaceAngle << " deg)";
+        log << std::endl;
+        log << "  " << factory.culledSubtractions(CaseFactory::BottomSide) << " / "
+            << factory.culledSubtractions(CaseFactory::TopSide) << " subtractions culled (bottom / top) as they cut no material"
+            << std::endl;
+    }
+    if (factory.coalescedForbiddenAreas() > 0)
+        log << "  " << factory.coalescedForbiddenAreas() << " forbidden areas coalesced (as many booleans less)" << std::endl;
+    printEstimates(log, factory);
+    log << bottom.log << top.log;
+
+    // 3) Both parts side by side (unless only the parts are wanted).
+    StageTimes times;
+    times.add(bottom.times);
+    times.add(top.times);
+    bool written = true;
+    if (job.combined) {
+        Clock::time_point combinedStart = Clock::now();
+        double offset = combinedOffset(factory);
+        std::string combinedFile = prefix + "-case.scad";
+        // The combined file depends on both parts
+        std::string key = job.cache ? hashText(bottomKey + " " + topKey) : "";
+        PartCache::Files combinedFiles = {{key + ".scad", combinedFile}};
+        if (job.cache && job.cache->fetch(combinedFiles)) {
+            log << "Using cached " << combinedFile << std::endl;
+        } else {
+            // Parts taken from the cache have to be constructed after all
+            if (bottom.cached)
+                bottom.solid = factory.constructBottomSolid();
+            if (top.cached)
+                top.solid = factory.constructTopSolid();
+
+            written = writeCombined(log, combinedFile, bottom.solid, top.solid, offset, job.sharedModules);
+            if (job.cache && written)
+                job.cache->store(combinedFiles);
+        }
+        times.add("write combined", millisecondsSince(combinedStart));
+    }
+
+    printTimes(log, times, millisecondsSince(start));
+
+    if (!bottom.error.empty() || !top.error.empty()) {
+        error = !bottom.error.empty() ? bottom.error : top.error;
+        return false;
+    }
+    if (!bottom.written || !top.written || !written) {
+        error = "cannot write the SCAD files to " + (job.outputDir.empty() ? "the current directory" : job.outputDir);
+        return false;
+    }
+    if (job.partFiles) {
+        job.partFiles->push_back(prefix + "-case-bottom.scad");
+        job.partFiles->push_back(prefix + "-case-top.scad");
+    }
+    return true;
+}
+
+
+bool runCaseJob(const CaseJob & job, std::ostream & log, std::string & error)
+{
+    TraceScope trace("runCaseJob", job.boardFile);
+    BoardDescription board;
+    if (!readBoardFile(job.boardFile, board, error))
+        return false;
+    if (board.name.empty())
+        board.name = baseName(job.boardFile);
+
+    // Create a factory to build a case for this board.
+    CaseFactory factory(board);
+    if (!configureFactory(factory, job.parameters, error))
+        return false;
+
+    std::string prefix = board.name;
+    if (!job.outputDir.empty()) {
+        if (!makeDirectories(job.outputDir)) {
+            error = "cannot create directory " + job.outputDir;
+            return false;
+        }
+        prefix = job.outputDir + "/" + board.name;
+    }
+
+
+    // The preview comes first, so it can be looked at while the final parts are generated
+    if (job.preview) {
+        bool preview = factory.preview;
+        factory.preview = true;
+        bool ok = writeCase(job, board, factory, prefix + "-preview", log, error);
+        factory.preview = preview;
+        if (!ok)
+            return false;
+    }
+    return writeCase(job, board, factory, prefix, log, error);
+}
+
+
+// What a watch iteration keeps for the next one
+struct WatchState {
+    std::string prefix;
+    std::string signatures[2];
+    Solid solids[2];
+};
+
+// Generates the parts whose signature differs from the state, and the combined file if any part changed.
+// On failure, returns false and sets error; the state then forces all parts to be generated again.
+static bool updateCaseJob(const CaseJob & job, WatchState & state, std::ostream & log, std::string & error)
+{
+    Clock::time_point start = Clock::now();
+    StageTimes times;
+
+    BoardDescription board;
+    if (!readBoardFile(job.boardFile, board, error))
+        return false;
+    if (board.name.empty())
+        board.name = baseName(job.boardFile);
+    CaseFactory factory(board);
+    if (!configureFactory(factory, job.parameters, error))
+        return false;
+    times.add("parse", millisecondsSince(start));
+
+    std::string prefix = job.outputDir.empty() ? board.name : job.outputDir + "/" + board.name;
+    if (prefix != state.prefix) {
+        if (!job.outputDir.empty() && !makeDirectories(job.outputDir)) {
+            error = "cannot create directory " + job.outputDir;
+            return false;
+        }
+        // New files, so nothing written before can be kept
+        state = WatchState();
+        state.prefix = prefix;
+    }
+
+    // Build the changed parts like runCaseJob does
+    CaseFactory::Side sides[2] = {CaseFactory::BottomSide, CaseFactory::TopSide};
+    std::string signatures[2];
+    PartOutput parts[2];
+    bool built[2] = {false, false};
+    bool changed = false;
+    for (auto side : sides) {
+        signatures[side] = partSignature(board, factory, side);
+        if (signatures[side] != state.signatures[side]) {
+            std::string key = job.cache ? cacheKey(board, factory, job, side) : "";
+            parts[side] = buildPart(job, factory, side, prefix, key);
+            built[side] = changed = true;
+        }
+    }
+
+    bool written = true;
+    for (auto side : sides) {
+        const char * name = (side == CaseFactory::BottomSide) ? "bottom" : "top";
+        if (!built[side]) {
+            log << "Unchanged " << prefix << "-case-" << name << ".scad" << std::endl;
+            continue;
+        }
+        PartOutput & part = parts[side];
+        log << part.log;
+        times.add(part.times);
+        if (part.cached)
+            part.solid = (side == CaseFactory::BottomSide) ? factory.constructBottomSolid() : factory.constructTopSolid();
+        state.solids[side] = part.solid;
+        // Forget the signature of a part which wasn't written, so the next iteration tries again
+        state.signatures[side] = part.written ? signatures[side] : "";
+        written = written && part.written;
+        if (error.empty())
+            error = part.error;
+    }
+
+    if (changed) {
+        Clock::time_point combinedStart = Clock::now();
+        bool combinedWritten = writeCombined(log, prefix + "-case.scad", state.solids[CaseFactory::BottomSide],
+                                             state.solids[CaseFactory::TopSide], combinedOffset(factory), job.sharedModules);
+        times.add("write combined", millisecondsSince(combinedStart));
+        if (!combinedWritten) {
+            // Rebuilding one part writes the combined file again
+            state.signatures[CaseFactory::BottomSide] = "";
+            written = false;
+        }
+    }
+
+    printTimes(log, times, millisecondsSince(start));
+
+    if (!written) {
+        if (error.empty())
+            error = "cannot write the SCAD files to " + (job.outputDir.empty() ? "the current directory" : job.outputDir);
+        return false;
+    }
+    return true;
+}
+
+
+// Waits until the file was written or replaced. Editors often save by writing a new file and renaming it over
+// the old one, which a watch on the file itself would miss, so this watches its directory.
+static bool waitForChange(int fd, const std::string & fileName)
+{
+    std::string name = fileName.substr(fileName.find_last_of('/') + 1);
+    alignas(inotify_event) char buffer[4096];
+    bool matched = false;
+    for (;;) {
+        // Once the file changed, keep draining events for a short while, so one save gives one update
+        pollfd descriptor = {fd, POLLIN, 0};
+        int ready = poll(&descriptor, 1, matched ? 10 : -1);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready <= 0)
+            return matched;
+
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0)
+            return false;
+        for (char * p = buffer; p < buffer + length; ) {
+            const inotify_event * event = reinterpret_cast<const inotify_event *>(p);
+            if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && name == event->name))
+                matched = true;
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+
+
+bool watchCaseJob(const CaseJob & job, std::ostream & log, std::string & error)
+{
+    // Invalid parameters won't get better by editing the board file
+    CaseFactory probe((BoardDescription()));
+    if (!configureFactory(probe, job.parameters, error))
+        return false;
+
+    size_t slash = job.boardFile.find_last_of('/');
+    std::string dir = (slash == std::string::npos) ? "." : job.boardFile.substr(0, slash + 1);
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        error = "cannot watch " + dir;
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    WatchState state;
+    for (bool first = true; ; first = false) {
+        // A broken board file is reported, then the next save is awaited
+        std::string iterationError;
+        bool updated = updateCaseJob(job, state, log, iterationError);
+        if (!updated)
+            log << iterationError << std::endl;
+
+        // Latency from the save to the updated files, as seen by the user
+        struct stat boardStat;
+        if (updated && !first && stat(job.boardFile.c_str(), &boardStat) == 0) {
+            auto saved = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::seconds(boardStat.st_mtim.tv_sec) + std::chrono::nanoseconds(boardStat.st_mtim.tv_nsec)));
+            log << "Updated " << std::fixed << std::setprecision(2)
+                << std::chrono::duration<double, std::milli>(std::chrono::system_clock::now() - saved).count()
+                << " ms after the board file was saved" << std::endl;
+            log.unsetf(std::ios::floatfield);
+        }
+
+        log << "Watching " << job.boardFile << " for changes ..." << std::endl;
+        if (!waitForChange(fd, job.boardFile))
+            break;
+    }
+
+    error = "cannot read the changes of " + dir;
+    close(fd);
+    return false;
+}
+
+
+bool writePlates(const std::vector<CaseJob> & jobs, const PlateJob & plate, std::ostream & log, std::string & error)
+{
+    TraceScope trace("writePlates");
+
+    // Both parts of each case, in print orientation. Copies share the solid, so they are written as one module.
+    Clock::time_point start = Clock::now();
+    std::vector<Solid> parts;
+    std::vector<PlateItem> items;
+    std::string prefix = plate.prefix;
+    for (const CaseJob & job : jobs) {
+        BoardDescription board;
+        if (!readBoardFile(job.boardFile, board, error))
+            return false;
+        if (board.name.empty())
+            board.name = baseName(job.boardFile);
+        CaseFactory factory(board);
+        if (!configureFactory(factory, job.parameters, error)) {
+            error = caseJobLabel(job) + ": " + error;
+            return false;
+        }
+        for (Solid part : {factory.constructBottomSolid(), factory.constructTopSolid()}) {
+            // Move the part's corner to the origin. The holes reach a bit past the outer box, so the footprint is
+            // taken from the bounds as well.
+            Box bounds = part.bounds();
+            part.translate(-bounds.min.x, -bounds.min.y, -bounds.min.z);
+            for (int copy = 0; copy < plate.copies; copy++) {
+                parts.push_back(part);
+                items.push_back({bounds.max.x - bounds.min.x, bounds.max.y - bounds.min.y});
+            }
+        }
+        if (plate.prefix.empty() && jobs.size() == 1)
+            prefix = (job.outputDir.empty() ? "" : job.outputDir + "/") + board.name + "-plate";
+    }
+    if (prefix.empty()) {
+        // The directory all jobs write to, by whole path components
+        auto directory = [](const CaseJob & job) { return job.outputDir.empty() ? "" : job.outputDir + "/"; };
+        std::string common = jobs.empty() ? "" : directory(jobs[0]);
+        for (const CaseJob & job : jobs) {
+            std::string dir = directory(job);
+            size_t length = 0;
+            for (size_t i = 0; i < std::min(common.size(), dir.size()) && common[i] == dir[i]; i++) {
+                if (dir[i] == '/')
+                    length = i + 1;
+            }
+            common.resize(length);
+        }
+        prefix = common + "plate";
+    }
+    std::string directory = prefix.substr(0, prefix.find_last_of('/') + 1);
+    if (!directory.empty() && !makeDirectories(directory)) {
+        error = "cannot create directory " + directory;
+        return false;
+    }
+    double constructTime = millisecondsSince(start);
+
+    start = Clock::now();
+    std::vector<PlatePlacement> placements;
+    int plateCount;
+    {
+        TraceScope packTrace("packPlates");
+        plateCount = packPlates(items, plate.bedWidth, plate.bedDepth, plate.gap, placements, error);
+    }
+    if (plateCount == 0)
+        return false;
+    double packTime = millisecondsSince(start);
+
+    std::vector<std::vector<size_t>> partsOnPlate(plateCount);
+    for (size_t i = 0; i < parts.size(); i++)
+        partsOnPlate[placements[i].plate].push_back(i);
+
+    start = Clock::now();
+    std::streamsize precision = log.precision();
+    double usedArea = 0;
+    for (int p = 0; p < plateCount; p++) {
+        std::string fileName = prefix + "-" + std::to_string(p + 1) + ".scad";
+        TraceScope writeTrace("write", fileName);
+        ScadWriter writer(fileName);
+        if (plate.sharedModules) {
+            std::vector<Solid> models;
+            for (size_t i : partsOnPlate[p])
+                models.push_back(parts[i]);
+            writer.declareModules(models);
+        }
+
+        double area = 0;
+        for (size_t i : partsOnPlate[p]) {
+            const PlatePlacement & placement = placements[i];
+            std::ostringstream transform;
+            transform << std::setprecision(15) << "translate([" << placement.x << ", " << placement.y << ", 0])";
+            // Turned counterclockwise, the part's footprint reaches from -depth to 0 in x
+            if (placement.rotated)
+                transform << " translate([" << items[i].depth << ", 0, 0]) rotate([0, 0, 90])";
+            writer.begin(transform.str());
+            writer.write(parts[i]);
+            writer.end();
+            area += items[i].width * items[i].depth;
+        }
+        if (!writer.close()) {
+            error = "cannot write " + fileName;
+            return false;
+        }
+        writeTrace.setBytes(writer.stats().bytes);
+        usedArea += area;
+        log << "Plate " << fileName << ": " << partsOnPlate[p].size() << " parts, " << std::fixed << std::setprecision(1)
+            << 100 * area / (plate.bedWidth * plate.bedDepth) << " % of the bed (" << writer.stats().bytes
+            << " bytes)" << std::endl;
+        log.unsetf(std::ios::floatfield);
+        log.precision(precision);
+    }
+    double writeTime = millisecondsSince(start);
+
+    log << "Packed " << parts.size() << " parts onto " << plateCount << " plates of " << plate.bedWidth << " x "
+        << plate.bedDepth << " mm, " << std::fixed << std::setprecision(1)
+        << 100 * usedArea / (plateCount * plate.bedWidth * plate.bedDepth) << " % used" << std::endl
+        << std::setprecision(2) << "Timing: construct " << constructTime << " ms, pack " << packTime << " ms, write "
+        << writeTime << " ms" << std::endl;
+    log.unsetf(std::ios::floatfield);
+    log.precision(precision);
+    return true;
+}
+
+
+
+std::string caseJobLabel(const CaseJob & job)
+{
+    std::string label = baseName(job.boardFile);
+    for (auto parameter : job.parameters)
+        label += " " + parameter.first + "=" + parameter.second;
+    return label;
+}
+
+
+
+bool readManifest(const std::string & fileName, std::vector<CaseJob> & jobs, std::string & error)
+{
+    std::ifstream in(fileName);
+    if (!in) {
+        error = "cannot open " + fileName;
+        return false;
+    }
+
+    // Relative paths are relative to the manifest
+    size_t slash = fileName.find_last_of('/');
+    std::string manifestDir = (slash == std::string::npos) ? "" : fileName.substr(0, slash + 1);
+    auto resolve = [&](const std::string & path) {
+        return (path.empty() || path[0] == '/') ? path : manifestDir + path;
+    };
+
+    std::string outputRoot;
+    ParameterList fixed;
+    std::vector<std::pair<std::string, std::vector<std::string>>> variations;
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key))
+            continue;
+
+        std::vector<std::string> args;
+        for (std::string arg; fields >> arg; )
+            args.push_back(arg);
+
+        bool ok = true;
+        if (key == "output" && args.size() == 1) {
+            outputRoot = args[0];
+        } else if (key == "set" && args.size() == 2) {
+            fixed.push_back({args[0], args[1]});
+        } else if (key == "vary" && args.size() >= 2) {
+            variations.push_back({args[0], std::vector<std::string>(args.begin() + 1, args.end())});
+        } else if (key == "board" && args.size() == 1) {
+            // Cross product of all variations, counting like an odometer
+            std::vector<size_t> counter(variations.size(), 0);
+            for (;;) {
+                CaseJob job;
+                job.boardFile = resolve(args[0]);
+                job.parameters = fixed;
+                std::string dir = baseName(args[0]);
+                for (size_t i = 0; i < variations.size(); i++) {
+                    const std::string & name = variations[i].first;
+                    const std::string & value = variations[i].second[counter[i]];
+                    job.parameters.push_back({name, value});
+                    dir += "-" + name + "-" + value;
+                }
+                job.outputDir = resolve(outputRoot.empty() ? dir : outputRoot + "/" + dir);
+                jobs.push_back(job);
+
+                size_t i = 0;
+                while (i < counter.size() && ++counter[i] == variations[i].second.size())
+                    counter[i++] = 0;
+                if (i == counter.size())
+                    break;
+            }
+        } else if (key == "job" && args.size() >= 2) {
+            CaseJob job;
+            job.boardFile = resolve(args[0]);
+            job.outputDir = resolve(args[1]);
+            job.parameters = fixed;
+            for (size_t i = 2; i < args.size() && ok; i++) {
+                size_t equals = args[i].find('=');
+                ok = equals != std::string::npos;
+                job.parameters.push_back({args[i].substr(0, equals), args[i].substr(equals + 1)});
+            }
+            jobs.push_back(job);
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            error = fileName + ": line " + std::to_string(lineNumber) + ": invalid '" + key + "' statement";
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef CASEJOB_H
+#define CASEJOB_H
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+typedef std::vector<std::pair<std::string, std::string>> ParameterList;
+
+struct CaseFactory;
+class PartCache;
+
+
+// One case to generate: a board file, overrides for the CaseFactory
+// parameters and the directory to write the SCAD files to.
+struct CaseJob {
+    std::string boardFile;
+    ParameterList parameters;
+    std::string outputDir; // empty = current directory
+
+    // Evaluate the meshes with one thread per core (see evaluateMesh()).
+    // Batch mode turns this off when its pool already keeps all cores busy.
+    bool parallelMesh = true;
+
+    // Also evaluate the parts to meshes in process (see mesh.h) and write
+    // them as <name>-case-bottom.stl / .3mf etc.
+    bool stl = false;
+    bool threeMf = false;
+
+    // Write repeated subtrees (screw holes, port holes, corner spheres) once
+    // as SCAD modules instead of inlining every copy.
+    bool sharedModules = true;
+
+    // Also write the case in preview quality (see CaseFactory::preview) as
+    // <name>-preview-case-bottom.scad etc., before the final parts.
+    bool preview = false;
+
+    // Also write both parts side by side as <name>-case.scad. Not needed
+    // when only the parts are rendered (see renderer.h).
+    bool combined = true;
+
+    // Take unchanged parts from this cache instead of generating them, and
+    // store the generated ones in it. Null = no cache.
+    PartCache * cache = nullptr;
+
+    // If set, the SCAD files of the parts (not the combined one) are added
+    // to it, in the order they are written: bottom, top, the preview first.
+    std::vector<std::string> * partFiles = nullptr;
+};
+
+// Generates the case for the job and writes the SCAD files. Progress goes
+// to log. On failure, returns false and sets error.
+bool runCaseJob(const CaseJob & job, std::ostream & log, std::string & error);
+
+// Like runCaseJob, then generates the case again each time the board file
+// is saved. Only the parts whose features changed are constructed and
+// written; files are replaced at once, never left half written. Errors in
+// the board file are reported to log and don't end the watch. Runs until
+// the process is ended; returns false and sets error if watching fails.
+bool watchCaseJob(const CaseJob & job, std::ostream & log, std::string & error);
+
+// A print bed to pack parts onto, see writePlates
+struct PlateJob {
+    double bedWidth = 220; // mm
+    double bedDepth = 220;
+    double gap = 5;        // between parts, mm
+    int copies = 1;        // of each case
+    std::string prefix;    // files <prefix>-1.scad, <prefix>-2.scad, ...; empty = next to the case files (see writePlates)
+    bool sharedModules = true;
+};
+
+// Constructs both parts of the case of each job (for the job's board and
+// parameters; only its output directory is used), packs copies of them by
+// their bounds onto as few beds as possible (see platepacker.h) and writes one
+// SCAD file per bed. Without a prefix, the files are named like the case
+// files: <output directory>/<board name>-plate-<n>.scad for a single job, and
+// plate-<n>.scad in the directory all output directories have in common for
+// several. Progress and the use of each bed go to log. On failure, returns
+// false and sets error.
+bool writePlates(const std::vector<CaseJob> & jobs, const PlateJob & plate, std::ostream & log, std::string & error);
+
+// Sets the default parameters used for all jobs, then the given overrides.
+// On an invalid override, returns false and sets error.
+bool configureFactory(CaseFactory & factory, const ParameterList & parameters, std::string & error);
+
+// Short description of a job for progress output, like "cubieboard space=0.2"
+std::string caseJobLabel(const CaseJob & job);
+
+
+// A batch manifest lists many jobs, one statement per line ("#" starts a
+// comment):
+//
+//   output  <directory>               Root directory for the statements below (default: current directory)
+//   set     <parameter> <value>       Override a parameter for all jobs
+//   vary    <parameter> <value> ...   Generate one variant per value
+//   board   <board file>              Generate all variants for this board
+//   job     <board file> <directory> [<parameter>=<value> ...]
+//                                     A single job with its own output directory
+//
+// "board" generates the cross product of all "vary" statements before it.
+// Each variant goes to <output>/<board>[-<parameter>-<value>...], e.g.
+// "out/cubieboard-space-0.2". Relative board files and directories are
+// taken relative to the manifest.
+bool readManifest(const std::string & fileName, std::vector<CaseJob> & jobs, std::string & error);
+
+
+#endif // CASEJOB_H
@@ -0,0 +1,460 @@
+#include "clearance.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <sstream>
+
+
+
+// Axes of a Vec, to handle all three alike
+static double Vec::* const axes[3] = {&Vec::x, &Vec::y, &Vec::z};
+
+
+// Bounding volume hierarchy over boxes: a binary tree, split at the median of the box centers on the axis along
+// which they spread most, with up to leafSize boxes per leaf.
+class BoxTree
+{
+public:
+    explicit BoxTree(const std::vector<Box> & boxes) :
+        boxes(boxes)
+    {
+        for (size_t i = 0; i < boxes.size(); i++)
+            order.push_back(i);
+        if (!boxes.empty())
+            build(0, order.size());
+    }
+
+    // Calls found(i) for each box i whose interior overlaps the given box.
+    template <typename Found>
+    void query(const Box & box, Found found) const
+    {
+        std::vector<size_t> stack;
+        if (!nodes.empty())
+            stack.push_back(0);
+        while (!stack.empty()) {
+            const Node & node = nodes[stack.back()];
+            stack.pop_back();
+            if (!node.bounds.overlaps(box))
+                continue;
+            if (node.left == 0) {
+                for (size_t i = node.first; i < node.first + node.count; i++) {
+                    if (boxes[order[i]].overlaps(box))
+                        found(order[i]);
+                }
+            } else {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+private:
+    static const size_t leafSize = 4;
+
+    struct Node {
+        Box bounds;
+        size_t left = 0, right = 0; // children, 0 = leaf (the root is never a child)
+        size_t first = 0, count = 0; // boxes of a leaf in order
+    };
+
+    size_t build(size_t begin, size_t end)
+    {
+        size_t index = nodes.size();
+        nodes.push_back(Node());
+
+        Box bounds, centers;
+        for (size_t i = begin; i < end; i++) {
+            const Box & box = boxes[order[i]];
+            bounds.extend(box);
+            centers.extend((box.min + box.max) / 2);
+        }
+        nodes[index].bounds = bounds;
+        if (end - begin <= leafSize) {
+            nodes[index].first = begin;
+            nodes[index].count = end - begin;
+            return index;
+        }
+
+        double Vec::* axis = &Vec::x;
+        for (double Vec::* a : axes) {
+            if (centers.max.*a - centers.min.*a > centers.max.*axis - centers.min.*axis)
+                axis = a;
+        }
+        size_t middle = (begin + end) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](size_t i, size_t j) {
+            return boxes[i].min.*axis + boxes[i].max.*axis < boxes[j].min.*axis + boxes[j].max.*axis;
+        });
+        size_t left = build(begin, middle);
+        size_t right = build(middle, end);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    const std::vector<Box> & boxes;
+    std::vector<size_t> order;
+    std::vector<Node> nodes;
+};
+
+
+
+// Distance between the convex polygons a and b (0 if they intersect). Polygons may be single points or segments.
+static double convexDistance(const std::vector<Point> & a, const std::vector<Point> & b)
+{
+    auto edges = [](const std::vector<Point> & polygon) {
+        std::vector<std::pair<Point, Point>> result;
+        for (size_t i = 0; i < polygon.size(); i++) {
+            result.push_back({polygon[i], polygon[(i + 1) % polygon.size()]});
+            if (polygon.size() <= 2)
+                break;
+        }
+        return result;
+    };
+    auto project = [](const std::vector<Point> & polygon, Point axis, double & min, double & max) {
+        min = HUGE_VAL;
+        max = -HUGE_VAL;
+        for (Point p : polygon) {
+            min = std::min(min, p.x * axis.x + p.y * axis.y);
+            max = std::max(max, p.x * axis.x + p.y * axis.y);
+        }
+    };
+    auto pointToSegment = [](Point p, Point s, Point t) {
+        double dx = t.x - s.x, dy = t.y - s.y;
+        double length2 = dx * dx + dy * dy;
+        double u = length2 > 0 ? std::max(0.0, std::min(1.0, ((p.x - s.x) * dx + (p.y - s.y) * dy) / length2)) : 0;
+        return std::hypot(p.x - s.x - u * dx, p.y - s.y - u * dy);
+    };
+
+    // Separating axis test on the edge normals of both
+    auto edgesA = edges(a);
+    auto edgesB = edges(b);
+    bool separated = false;
+    for (auto edgeList : {&edgesA, &edgesB}) {
+        for (auto edge : *edgeList) {
+            Point normal = {edge.first.y - edge.second.y, edge.second.x - edge.first.x};
+            if (normal.x == 0 && normal.y == 0)
+                continue;
+            double minA, maxA, minB, maxB;
+            project(a, normal, minA, maxA);
+            project(b, normal, minB, maxB);
+            if (maxA < minB || maxB < minA)
+                separated = true;
+        }
+    }
+    if (!separated)
+        return 0;
+
+    // Disjoint convex polygons are closest at a vertex of one of them
+    double distance = HUGE_VAL;
+    for (Point p : a) {
+        for (auto edge : edgesB)
+            distance = std::min(distance, pointToSegment(p, edge.first, edge.second));
+    }
+    for (Point p : b) {
+        for (auto edge : edgesA)
+            distance = std::min(distance, pointToSegment(p, edge.first, edge.second));
+    }
+    return distance;
+}
+
+
+// How deep a subtractive feature cuts into the box of an additive one, 0 if not at all
+static double overlapDepth(const CaseFeature & feature, const Box & box)
+{
+    Box common = feature.bounds.intersection(box);
+    if (common.empty())
+        return 0;
+    double depth = std::min({common.max.x - common.min.x, common.max.y - common.min.y, common.max.z - common.min.z});
+    if (feature.axis < 0)
+        return depth;
+
+    // Rounded prism: compare the hull of the profile with the box in the plane across the axis
+    double Vec::* u = axes[(feature.axis + 1) % 3];
+    double Vec::* v = axes[(feature.axis + 2) % 3];
+    if (feature.axis == 1)
+        std::swap(u, v); // profiles are given as (x, z)
+    std::vector<Point> rectangle = {{box.min.*u, box.min.*v}, {box.max.*u, box.min.*v},
+                                    {box.max.*u, box.max.*v}, {box.min.*u, box.max.*v}};
+    double distance = convexDistance(convexHull(feature.profile), rectangle);
+    if (distance >= feature.radius)
+        return 0;
+    return (distance > 0) ? std::min(depth, feature.radius - distance) : depth;
+}
+
+
+// Ports may pass through wall supports, which are there to hold the wall beside them. A port is a mistake only
+// where it cuts through the part of a support within the cavity completely, across its whole width along the wall
+// and its height, or leaves less of it than minWall beside the hole. Returns false if neither, else the kind of
+// issue and the depth of the cut or the width left. The wall of the support is where it reaches out of the cavity.
+static bool checkPortInSupport(const CaseFeature & port, const Box & supportBounds, const Box & cavity, double minWall,
+                               CaseIssue::Kind & kind, double & value)
+{
+    int inset = (supportBounds.min.x < cavity.min.x || supportBounds.max.x > cavity.max.x) ? 0 : 1;
+    double Vec::* d = axes[inset];
+    double Vec::* w = axes[1 - inset];
+    Box support = supportBounds.intersection(cavity);
+    double tolerance = eps + 1e-9;
+    if (overlapDepth(port, support) <= tolerance)
+        return false;
+
+    Box common = port.bounds.intersection(support);
+    bool across = common.min.*w <= support.min.*w + tolerance && common.max.*w >= support.max.*w - tolerance &&
+                  common.min.z <= support.min.z + tolerance && common.max.z >= support.max.z - tolerance;
+    if (across && port.axis == inset) {
+        // The rounded prism along the support has to cover its whole cross section (profiles are (w, z) here)
+        std::vector<Point> hull = convexHull(port.profile);
+        for (Point corner : {Point{support.min.*w, support.min.z}, Point{support.max.*w, support.min.z},
+                             Point{support.max.*w, support.max.z}, Point{support.min.*w, support.max.z}}) {
+            if (convexDistance(hull, {corner}) > port.radius + tolerance)
+                across = false;
+        }
+    }
+    if (across) {
+        kind = CaseIssue::Overlap;
+        value = common.max.*d - common.min.*d;
+        return true;
+    }
+
+    double left = HUGE_VAL;
+    if (port.bounds.min.*w > support.min.*w + tolerance)
+        left = std::min(left, port.bounds.min.*w - support.min.*w);
+    if (port.bounds.max.*w < support.max.*w - tolerance)
+        left = std::min(left, support.max.*w - port.bounds.max.*w);
+    if (left >= minWall)
+        return false;
+    kind = CaseIssue::ThinWall;
+    value = left;
+    return true;
+}
+
+
+static std::string featureName(const CaseFeature & feature)
+{
+    static const char * names[] = {"screw enclosure", "screw hole", "screw head hole", "hole nut", "wall support",
+                                   "port", "port", "forbidden area"};
+    return std::string(names[feature.kind]) + " " + std::to_string(feature.index);
+}
+
+
+static void checkPart(const BoardDescription & board, CaseFactory & factory, CaseFactory::Side side, double minWall,
+                      std::vector<CaseIssue> & issues)
+{
+    PartLayout layout = factory.layout(side);
+    std::string sideName = (side == CaseFactory::BottomSide) ? "bottom" : "top";
+    auto issue = [&](CaseIssue::Kind kind, const CaseFeature & feature, double value, const std::string & message) {
+        CaseIssue result;
+        result.kind = kind;
+        result.side = sideName;
+        result.feature = featureName(feature);
+        result.value = value;
+        result.bounds = feature.bounds;
+        result.message = message;
+        issues.push_back(result);
+        return issues.size() - 1;
+    };
+
+    // Overlaps of holes with the enclosures and supports. The hole and the chamfer of a port give one issue.
+    std::vector<size_t> additive;
+    std::vector<Box> additiveBoxes;
+    for (size_t i = 0; i < layout.features.size(); i++) {
+        if (layout.features[i].additive()) {
+            additive.push_back(i);
+            additiveBoxes.push_back(layout.features[i].bounds);
+        }
+    }
+    BoxTree tree(additiveBoxes);
+    std::map<std::pair<std::string, std::string>, size_t> reported; // issue index by features
+    auto report = [&](const CaseFeature & feature, const CaseFeature & other, CaseIssue::Kind kind, double value,
+                      const std::string & message) {
+        auto key = std::make_pair(featureName(feature), featureName(other));
+        if (reported.count(key)) {
+            // Of the hole and the chamfer, the deeper cut or the thinner wall counts
+            CaseIssue & previous = issues[reported[key]];
+            bool worse = (kind != previous.kind) ? kind == CaseIssue::Overlap :
+                         (kind == CaseIssue::Overlap) ? value > previous.value : value < previous.value;
+            if (worse) {
+                previous.kind = kind;
+                previous.value = value;
+                previous.message = message;
+            }
+            return;
+        }
+        size_t index = issue(kind, feature, value, message);
+        issues[index].other = key.second;
+        reported[key] = index;
+    };
+    for (const CaseFeature & original : layout.features) {
+        if (original.additive() || original.kind == CaseFeature::ForbiddenArea)
+            continue;
+        CaseFeature feature = original;
+        bool port = feature.kind == CaseFeature::PortHole || feature.kind == CaseFeature::PortChamfer;
+        // Ports only cut the wall (or floor) they pass through; the space between it and the board is empty anyway
+        if (port) {
+            double Vec::* a = axes[feature.axis];
+            if (feature.bounds.min.*a + feature.bounds.max.*a < layout.cavity.min.*a + layout.cavity.max.*a || feature.axis == 2)
+                feature.bounds.max.*a = std::min(feature.bounds.max.*a, layout.cavity.min.*a);
+            else
+                feature.bounds.min.*a = std::max(feature.bounds.min.*a, layout.cavity.max.*a);
+        }
+        tree.query(feature.bounds, [&](size_t i) {
+            const CaseFeature & other = layout.features[additive[i]];
+            if (port && other.kind == CaseFeature::WallSupport)
+                return;
+            // Each screw hole and nut cavity belongs into its own enclosure
+            bool own = (other.kind == CaseFeature::ScrewEnclosure) &&
+                ((feature.kind == CaseFeature::ScrewHole || feature.kind == CaseFeature::ScrewHeadHole) ? feature.index == other.index :
+                 (feature.kind == CaseFeature::NutCavity) ? board.holeNuts[feature.index].holeIndex == other.index : false);
+            // Subtractions overlap the surfaces they cut by eps on purpose
+            double depth = own ? 0 : overlapDepth(feature, other.bounds);
+            if (depth > eps + 1e-9)
+                report(feature, other, CaseIssue::Overlap, depth, featureName(feature) + " cuts into " + featureName(other));
+        });
+        if (!port)
+            continue;
+
+        // The wall supports are within the cavity, where the port is taken as a whole
+        tree.query(original.bounds, [&](size_t i) {
+            const CaseFeature & other = layout.features[additive[i]];
+            CaseIssue::Kind kind;
+            double value;
+            if (other.kind != CaseFeature::WallSupport ||
+                !checkPortInSupport(original, other.bounds, layout.cavity, minWall, kind, value))
+                return;
+            std::ostringstream message;
+            if (kind == CaseIssue::Overlap)
+                message << featureName(original) << " cuts through " << featureName(other);
+            else
+                message << featureName(original) << " leaves " << value << " mm of " << featureName(other) << " beside it";
+            report(original, other, kind, value, message.str());
+        });
+    }
+
+    // Wall supports have to be within the case
+    for (const CaseFeature & feature : layout.features) {
+        if (feature.kind == CaseFeature::WallSupport && !layout.outer.contains(feature.bounds))
+            issue(CaseIssue::OutOfBounds, feature, 0, featureName(feature) + " reaches out of the case");
+    }
+
+    // Material left between holes or forbidden areas and the outside of the case, in each direction in which
+    // they reach beyond the cavity. The cavity is open towards max z.
+    for (const CaseFeature & feature : layout.features) {
+        if (feature.additive() || feature.kind == CaseFeature::PortChamfer)
+            continue;
+        for (int axis = 0; axis < 3; axis++) {
+            double Vec::* a = axes[axis];
+            for (int towardsMax = 0; towardsMax < 2; towardsMax++) {
+                if (axis == 2 && towardsMax)
+                    continue;
+                // Ports pass through their wall, and are open towards the edges of the board they reach over
+                if (feature.kind == CaseFeature::PortHole) {
+                    double edge = (axis == 2 || !towardsMax) ? 0 : board.size[axis];
+                    if (axis == feature.axis ||
+                        (axis < 2 && (towardsMax ? feature.bounds.max.*a > edge : feature.bounds.min.*a < edge)))
+                        continue;
+                }
+                // Screw heads are inserted from below, and the screw hole continues the head hole
+                if ((feature.kind == CaseFeature::ScrewHole || feature.kind == CaseFeature::ScrewHeadHole) && axis == 2)
+                    continue;
+
+                double wall = towardsMax ? layout.outer.max.*a - feature.bounds.max.*a
+                                         : feature.bounds.min.*a - layout.outer.min.*a;
+                bool inCavity = towardsMax ? feature.bounds.max.*a <= layout.cavity.max.*a
+                                           : feature.bounds.min.*a >= layout.cavity.min.*a;
+                if (inCavity || wall >= minWall)
+                    continue;
+                std::ostringstream message;
+                if (wall < 0)
+                    message << featureName(feature) << " breaks through the case";
+                else
+                    message << featureName(feature) << " leaves a wall of " << wall << " mm";
+                message << " towards " << (towardsMax ? "+" : "-") << "xyz"[axis];
+                issue(wall < 0 ? CaseIssue::OutOfBounds : CaseIssue::ThinWall, feature, wall, message.str());
+            }
+        }
+    }
+}
+
+
+
+const char * caseIssueKindName(CaseIssue::Kind kind)
+{
+    static const char * names[] = {"invalidBoard", "overlap", "thinWall", "outOfBounds"};
+    return names[kind];
+}
+
+
+std::vector<CaseIssue> checkCase(const BoardDescription & board, CaseFactory & factory, double minWall)
+{
+    std::vector<CaseIssue> issues;
+
+    for (size_t i = 0; i < board.holes.size(); i++) {
+        Point hole = board.holes[i];
+        if (hole.x < 0 || hole.x > board.size[0] || hole.y < 0 || hole.y > board.size[1]) {
+            CaseIssue issue;
+            issue.kind = CaseIssue::OutOfBounds;
+            issue.feature = "hole " + std::to_string(i);
+            issue.bounds.extend(Vec{hole.x, hole.y, 0});
+            issue.message = issue.feature + " lies outside the board";
+            issues.push_back(issue);
+        }
+    }
+    for (size_t i = 0; i < board.holeNuts.size(); i++) {
+        int holeIndex = board.holeNuts[i].holeIndex;
+        if (holeIndex < 0 || holeIndex >= int(board.holes.size())) {
+            CaseIssue issue;
+            issue.kind = CaseIssue::InvalidBoard;
+            issue.feature = "hole nut " + std::to_string(i);
+            issue.message = issue.feature + " refers to hole " + std::to_string(holeIndex) + ", but there are only "
+                            + std::to_string(board.holes.size()) + " holes";
+            issues.push_back(issue);
+        }
+    }
+
+    checkPart(board, factory, CaseFactory::BottomSide, minWall, issues);
+    checkPart(board, factory, CaseFactory::TopSide, minWall, issues);
+    return issues;
+}
+
+
+void writeCaseIssues(std::ostream & json, const std::vector<CaseIssue> & issues, const std::string & indent)
+{
+    json << "[";
+    const char * separator = "\n";
+    for (const CaseIssue & issue : issues) {
+        json << separator << indent << "{\"kind\": \"" << caseIssueKindName(issue.kind) << "\", \"side\": "
+             << (issue.side.empty() ? "null" : jsonString(issue.side)) << ", \"feature\": " << jsonString(issue.feature)
+             << ", \"other\": " << (issue.other.empty() ? "null" : jsonString(issue.other))
+             << ", \"value\": " << issue.value;
+        if (issue.bounds.empty()) {
+            json << ", \"bounds\": null";
+        } else {
+            json << ", \"bounds\": [[" << issue.bounds.min.x << ", " << issue.bounds.min.y << ", " << issue.bounds.min.z
+                 << "], [" << issue.bounds.max.x << ", " << issue.bounds.max.y << ", " << issue.bounds.max.z << "]]";
+        }
+        json << ", \"message\": " << jsonString(issue.message) << "}";
+        separator = ",\n";
+    }
+    if (!issues.empty())
+        json << "\n" << indent.substr(0, indent.size() >= 2 ? indent.size() - 2 : 0);
+    json << "]";
+}
+
+
+std::string jsonString(const std::string & text)
+{
+    std::string quoted = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
@@ -0,0 +1,54 @@
+#ifndef CLEARANCE_H
+#define CLEARANCE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "boarddescription.h"
+#include "casefactory.h"
+
+
+// A problem found in a board description, see checkCase()
+struct CaseIssue {
+    enum Kind {
+        InvalidBoard,     // the board file can't be read, or refers to missing holes
+        Overlap,          // a hole cuts into a screw enclosure it doesn't belong to, or a port through a wall support
+        ThinWall,         // a hole or forbidden area leaves less than the minimum wall towards the outside, or a port
+                          // less than that of a wall support beside it
+        OutOfBounds       // a feature breaks through the case or lies outside the board
+    };
+
+    Kind kind;
+    std::string side;    // "bottom", "top" or empty for the whole board
+    std::string feature; // like "port 2" (index in the board description; see CaseFeature)
+    std::string other;   // overlapped feature, or empty
+    double value = 0;    // overlap depth or wall thickness in mm
+    Box bounds;          // of the feature, as in CaseFactory::layout()
+    std::string message;
+};
+
+const char * caseIssueKindName(CaseIssue::Kind kind);
+
+
+// Checks the board description for mistakes which otherwise only show up
+// after rendering or printing: holes (ports, screw holes, nut cavities)
+// cutting into the screw enclosure of another hole, ports cutting through a
+// wall support or leaving less than minWall of it beside the hole, holes and
+// forbidden areas leaving walls thinner than minWall or breaking through the
+// case, features outside the board, and hole nuts referring to missing
+// holes. The features of each part are taken from CaseFactory::layout(),
+// without constructing the part. Overlaps are found with a bounding volume
+// hierarchy over the enclosures and supports, so the check takes
+// O(n log n) for n features. Forbidden areas may cut enclosures (that is
+// what they are for), and ports are meant to pass through walls and the
+// wall supports beside them.
+std::vector<CaseIssue> checkCase(const BoardDescription & board, CaseFactory & factory, double minWall);
+
+// Writes the issues as JSON array, one object per line, each line indented by indent.
+void writeCaseIssues(std::ostream & json, const std::vector<CaseIssue> & issues, const std::string & indent);
+
+// Quotes and escapes text as JSON string.
+std::string jsonString(const std::string & text);
+
+
+#endif // CLEARANCE_H
@@ -0,0 +1,385 @@
+#include "csgbuilder.h"
+
+#include <algorithm>
+
+
+
+const char * csgModeName(CsgMode mode)
+{
+    switch (mode) {
+    case SequentialCsg: return "sequential";
+    case FlatCsg:       return "flat";
+    case BalancedCsg:   return "balanced";
+    }
+    return "?";
+}
+
+
+bool parseCsgMode(const std::string & name, CsgMode & mode)
+{
+    for (CsgMode m : {SequentialCsg, FlatCsg, BalancedCsg}) {
+        if (name == csgModeName(m)) {
+            mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+// Appends boxes which lie completely inside the solid, for cuboids (also translated or scaled ones) and
+// extruded rounded rectangles. Returns false for other solids.
+static bool innerBoxes(const Solid & solid, std::vector<Box> & boxes)
+{
+    switch (solid.kind()) {
+    case Solid::CubeKind:
+        boxes.push_back(solid.bounds());
+        return true;
+    case Solid::RoundedRectKind: {
+        // The rectangle without the rounded corners, as a cross of two boxes
+        double r = std::max(solid.param(3), 0.0);
+        Box box = solid.bounds();
+        Box cross = box;
+        box.min.x += r;
+        box.max.x -= r;
+        cross.min.y += r;
+        cross.max.y -= r;
+        boxes.push_back(box);
+        if (r > 0)
+            boxes.push_back(cross);
+        return true;
+    }
+    case Solid::TranslateKind:
+    case Solid::ScaleKind: {
+        size_t first = boxes.size();
+        if (!innerBoxes(solid.children()[0], boxes))
+            return false;
+        Matrix m = solid.matrix();
+        for (size_t i = first; i < boxes.size(); i++)
+            boxes[i] = m * boxes[i];
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+
+// Appends the parts of box a outside of box b, as up to six boxes.
+static void subtractBox(const Box & a, const Box & b, std::vector<Box> & out)
+{
+    if (!a.overlaps(b)) {
+        out.push_back(a);
+        return;
+    }
+    Box rest = a;
+    for (double Vec::*axis : {&Vec::x, &Vec::y, &Vec::z}) {
+        if (rest.min.*axis < b.min.*axis) {
+            Box slab = rest;
+            slab.max.*axis = b.min.*axis;
+            out.push_back(slab);
+            rest.min.*axis = b.min.*axis;
+        }
+        if (b.max.*axis < rest.max.*axis) {
+            Box slab = rest;
+            slab.min.*axis = b.max.*axis;
+            out.push_back(slab);
+            rest.max.*axis = b.max.*axis;
+        }
+    }
+    // What is left of a is inside b
+}
+
+
+// Appends boxes which together cover all material of the solid.
+static void coverMaterial(const Solid & solid, std::vector<Box> & boxes)
+{
+    size_t first = boxes.size();
+    switch (solid.kind()) {
+    case Solid::UnionKind:
+        for (const Solid & child : solid.children())
+            coverMaterial(child, boxes);
+        return;
+
+    case Solid::DifferenceKind:
+        if (solid.children().empty())
+            return;
+        coverMaterial(solid.children()[0], boxes);
+        for (size_t i = 1; i < solid.children().size(); i++) {
+            std::vector<Box> cuts;
+            if (!innerBoxes(solid.children()[i], cuts))
+                continue;
+            for (const Box & cut : cuts) {
+                std::vector<Box> rest;
+                for (size_t j = first; j < boxes.size(); j++)
+                    subtractBox(boxes[j], cut, rest);
+                boxes.resize(first);
+                boxes.insert(boxes.end(), rest.begin(), rest.end());
+            }
+        }
+        return;
+
+    case Solid::TranslateKind:
+    case Solid::ScaleKind:
+    case Solid::RotateEulerZXZKind:
+    case Solid::MatrixKind: {
+        coverMaterial(solid.children()[0], boxes);
+        Matrix m = solid.matrix();
+        for (size_t j = first; j < boxes.size(); j++)
+            boxes[j] = m * boxes[j];
+        return;
+    }
+
+    default: // primitives, intersections, hulls
+        Box box = solid.bounds();
+        if (!box.empty())
+            boxes.push_back(box);
+        return;
+    }
+}
+
+
+
+CsgBuilder::CsgBuilder(const Solid & base, CsgMode mode) :
+    mode(mode),
+    current(base)
+{
+    coverMaterial(base, material);
+}
+
+
+void CsgBuilder::add(const Solid & component)
+{
+    coverMaterial(component, material);
+    if (mode == SequentialCsg) {
+        current = current + component;
+        return;
+    }
+    additions.push_back(component);
+}
+
+
+void CsgBuilder::subtract(const Solid & component)
+{
+    Box bounds = component.bounds();
+    if (std::none_of(material.begin(), material.end(), [&](const Box & box) { return box.overlaps(bounds); })) {
+        culled++;
+        return;
+    }
+
+    if (mode == SequentialCsg)
+        current = current - component;
+    else
+        subtractions.push_back(component);
+}
+
+
+void CsgBuilder::intersect(const Solid & component)
+{
+    Box bounds = component.bounds();
+    std::vector<Box> clipped;
+    for (const Box & box : material) {
+        Box inside = box.intersection(bounds);
+        if (!inside.empty())
+            clipped.push_back(inside);
+    }
+    material.swap(clipped);
+
+    if (mode == SequentialCsg) {
+        current = current * component;
+        return;
+    }
+    current = unite(current, additions) * component;
+}
+
+
+void CsgBuilder::flush()
+{
+    if (mode == SequentialCsg)
+        return;
+
+    current = unite(current, additions);
+    if (subtractions.empty())
+        return;
+
+    if (mode == BalancedCsg) {
+        current = current - balanced(subtractions, 0, subtractions.size());
+    } else {
+        subtractions.insert(subtractions.begin(), current);
+        current = Solid::combine(Solid::DifferenceKind, subtractions);
+    }
+    subtractions.clear();
+}
+
+
+Solid CsgBuilder::result()
+{
+    flush();
+    return current;
+}
+
+
+// Unites first with all components in rest and clears rest.
+Solid CsgBuilder::unite(const Solid & first, std::vector<Solid> & rest)
+{
+    if (rest.empty())
+        return first;
+
+    Solid united;
+    if (mode == BalancedCsg) {
+        united = first + balanced(rest, 0, rest.size());
+    } else {
+        rest.insert(rest.begin(), first);
+        united = Solid::combine(Solid::UnionKind, rest);
+    }
+    rest.clear();
+    return united;
+}
+
+
+// Binary union tree of depth log2(end - begin) over components[begin..end).
+Solid CsgBuilder::balanced(std::vector<Solid> & components, size_t begin, size_t end)
+{
+    if (end - begin == 1)
+        return components[begin];
+    size_t mid = begin + (end - begin) / 2;
+    return balanced(components, begin, mid) + balanced(components, mid, end);
+}
+
+
+
+// CANONICAL FORM
+
+static bool isEmpty(const Solid & solid)
+{
+    return solid.kind() == Solid::UnionKind && solid.children().empty();
+}
+
+
+static bool isConvex(const Solid & solid)
+{
+    if (solid.isPrimitive() || solid.kind() == Solid::HullKind)
+        return true;
+    return solid.isTransform() && isConvex(solid.children()[0]);
+}
+
+
+static bool isIdentity(const Matrix & transform)
+{
+    return transform.isTranslation() && transform.m[0][3] == 0 && transform.m[1][3] == 0 && transform.m[2][3] == 0;
+}
+
+
+// The solid transformed by the matrix, with as few nodes as possible.
+static Solid place(const Solid & solid, const Matrix & transform)
+{
+    if (isIdentity(transform) || isEmpty(solid))
+        return solid;
+    if (!transform.isTranslation())
+        return solid.transformedCopy(transform);
+    return solid.translatedCopy(transform.m[0][3], transform.m[1][3], transform.m[2][3]);
+}
+
+
+// A primitive transformed by the matrix. If the transformation mirrors along axes and the primitive is
+// symmetric to a plane normal to each of them, the primitive is moved to the mirrored position instead.
+static Solid placePrimitive(const Solid & primitive, const Matrix & transform)
+{
+    double flip[3], offset[3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            if (i != j && transform.m[i][j] != 0)
+                return place(primitive, transform);
+        }
+        flip[i] = transform.m[i][i];
+        offset[i] = transform.m[i][3];
+        if (flip[i] != 1 && flip[i] != -1)
+            return place(primitive, transform);
+    }
+
+    Solid result = primitive;
+    switch (primitive.kind()) {
+    case Solid::CubeKind:
+    case Solid::RoundedRectKind:
+        // Symmetric to their center planes, the mirrored box ends where it would start
+        for (int i = 0; i < 3; i++) {
+            if (flip[i] < 0)
+                offset[i] -= primitive.param(i);
+        }
+        break;
+    case Solid::CylinderKind:
+        // OpenSCAD starts the polygon at angle 0, so it is symmetric to y = 0, and to x = 0 with an even
+        // number of faces. Mirrored along z, it is the reversed cone.
+        if (flip[0] < 0 && int(primitive.param(3)) % 2 != 0)
+            return place(primitive, transform);
+        if (flip[2] < 0) {
+            result = Solid::cone(primitive.param(1), primitive.param(0), primitive.param(2), primitive.param(3));
+            offset[2] -= primitive.param(2);
+        }
+        break;
+    case Solid::SphereKind:
+        // Like a cylinder, and the rings are symmetric to z = 0
+        if (flip[0] < 0 && int(primitive.param(1)) % 2 != 0)
+            return place(primitive, transform);
+        break;
+    default:
+        return place(primitive, transform);
+    }
+    return place(result, Matrix::translation(offset[0], offset[1], offset[2]));
+}
+
+
+// The solid transformed by the matrix, in canonical form (see canonicalCsg)
+static Solid fold(const Solid & solid, const Matrix & transform)
+{
+    if (solid.isPrimitive())
+        return placePrimitive(solid, transform);
+
+    if (solid.isTransform()) {
+        // Scalings other than mirrors aren't rigid, so they stay where they are (see Solid::transformedCopy)
+        if (solid.kind() == Solid::ScaleKind &&
+                !(std::abs(solid.param(0)) == 1 && std::abs(solid.param(1)) == 1 && std::abs(solid.param(2)) == 1)) {
+            Solid scaled = fold(solid.children()[0], Matrix::identity());
+            scaled.scale(solid.param(0), solid.param(1), solid.param(2));
+            return place(scaled, transform);
+        }
+        // A single translation is canonical already, so it is kept if nothing below it changes
+        const Solid & child = solid.children()[0];
+        if (solid.kind() == Solid::TranslateKind && isIdentity(transform) && !child.isTransform()) {
+            Solid folded = fold(child, transform);
+            return (folded.identity() == child.identity()) ? solid : place(folded, solid.matrix());
+        }
+        return fold(child, transform * solid.matrix());
+    }
+
+    // The rotation and mirror go down to the operands, the translation stays on the boolean. So equal subtrees
+    // in different places stay equal, for ScadWriter::declareModules.
+    Matrix linear = transform;
+    for (auto & row : linear.m)
+        row[3] = 0;
+    Solid::Kind kind = solid.kind();
+    std::vector<Solid> operands;
+    bool unchanged = isIdentity(linear);
+    for (size_t i = 0; i < solid.children().size(); i++) {
+        Solid operand = fold(solid.children()[i], linear);
+        unchanged = unchanged && operand.identity() == solid.children()[i].identity();
+        if (!isEmpty(operand))
+            operands.push_back(operand);
+        else if (kind == Solid::IntersectionKind || (kind == Solid::DifferenceKind && i == 0))
+            return Solid();
+    }
+    if (operands.empty())
+        return Solid();
+
+    Solid result = (operands.size() == 1 && (kind != Solid::HullKind || isConvex(operands[0]))) ? operands[0] :
+                   (unchanged && operands.size() == solid.children().size()) ? solid :
+                   Solid::combine(kind, operands);
+    return place(result, Matrix::translation(transform.m[0][3], transform.m[1][3], transform.m[2][3]));
+}
+
+
+Solid canonicalCsg(const Solid & solid)
+{
+    return fold(solid, Matrix::identity());
+}
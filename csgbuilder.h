@@ -0,0 +1,101 @@
+#ifndef CSGBUILDER_H
+#define CSGBUILDER_H
+
+#include <string>
+#include <vector>
+#include <ooml/components.h>
+#include "solid.h"
+
+
+// How the features of a part are combined into one CSG tree.
+enum CsgMode {
+    // One boolean per feature operand: ((base + a1) - s1) + a2 ...
+    // This is a left-deep tree whose depth grows with the number of features.
+    SequentialCsg,
+
+    // All additive features in one n-ary union, all subtractive features in
+    // one n-ary difference. The tree depth no longer depends on the number
+    // of features.
+    FlatCsg,
+
+    // Like FlatCsg, but built from binary unions only, arranged as balanced
+    // trees (depth log n). For consumers which don't handle n-ary nodes well.
+    BalancedCsg
+};
+
+const char * csgModeName(CsgMode mode);
+bool parseCsgMode(const std::string & name, CsgMode & mode);
+
+
+// Collects the features of one part and combines them according to a CsgMode.
+//
+// Features are added in the same order as they would be applied one by one.
+// In the flat modes, additions and subtractions are gathered and combined as
+//     (base + add1 + add2 + ...) - (sub1 + sub2 + ...)
+// which is only the same geometry if no addition overlaps an earlier
+// subtraction. Where the caller can't rule that out, it has to call flush()
+// in between, which combines everything gathered so far.
+//
+// In all modes, subtractions which can't remove any material are dropped:
+// the builder keeps a set of boxes covering all material gathered so far
+// (primitives and hulls by their bounds, differences minus the cuboids and
+// rounded rectangles subtracted from them), and a subtraction whose bounds
+// don't overlap any of them only cuts air.
+class CsgBuilder
+{
+public:
+    CsgBuilder(const Solid & base, CsgMode mode);
+
+    void add(const Solid & component);
+    void subtract(const Solid & component);
+
+    // Intersects everything gathered so far with the given component.
+    // Subtractions are kept pending, as (a - s) * b == (a * b) - s.
+    // Additions after this call are not clipped by it.
+    void intersect(const Solid & component);
+
+    void flush();
+
+    // Flushes and returns the combined result.
+    Solid result();
+
+    // Number of subtractions dropped because they cut no material
+    int culledSubtractions() const { return culled; }
+
+private:
+    Solid unite(const Solid & first, std::vector<Solid> & rest);
+    Solid balanced(std::vector<Solid> & components, size_t begin, size_t end);
+
+    CsgMode mode;
+    Solid current;
+    std::vector<Solid> additions;
+    std::vector<Solid> subtractions;
+
+    std::vector<Box> material; // covers everything gathered so far
+    int culled = 0;
+};
+
+
+// Canonical form of a finished tree, with the same geometry in fewer nodes:
+// - Consecutive transformations are folded into one per primitive (a
+//   translation, or a matrix for rotations and mirrors). Rotations and
+//   mirrors go down to the primitives, translations stay on the booleans.
+// - Mirrors along the axes are absorbed into primitives which are symmetric
+//   to them, like the y mirror of the top part into its cuboids.
+// - Empty operands are dropped, and unions, differences and intersections
+//   of a single operand are replaced by it (hulls only if it is convex).
+// Scalings other than mirrors aren't folded.
+Solid canonicalCsg(const Solid & solid);
+
+
+// Size of a generated CSG tree, to compare the different CsgModes.
+struct CsgStats {
+    int nodes = 0;    // primitives, transformations and booleans
+    int booleans = 0; // union, difference, intersection, hull
+    int depth = 0;    // maximum nesting of booleans
+    size_t bytes = 0; // size of the SCAD output
+    size_t facets = 0; // triangles of all primitives (see Solid::primitiveFacets)
+};
+
+
+#endif // CSGBUILDER_H
@@ -0,0 +1,90 @@
+#include "forbiddenareas.h"
+
+#include <algorithm>
+
+
+
+// Whether area a covers area b
+static bool contains(const ForbiddenAreaDescription & a, const ForbiddenAreaDescription & b)
+{
+    return a.x <= b.x && b.x + b.sx <= a.x + a.sx &&
+           a.y <= b.y && b.y + b.sy <= a.y + a.sy &&
+           b.sz <= a.sz;
+}
+
+
+// If a and b together form one cuboid, stores it in b and returns true.
+static bool merge(const ForbiddenAreaDescription & a, ForbiddenAreaDescription & b)
+{
+    if (a.sz != b.sz)
+        return false;
+
+    if (a.y == b.y && a.sy == b.sy && a.x <= b.x + b.sx && b.x <= a.x + a.sx) {
+        double end = std::max(a.x + a.sx, b.x + b.sx);
+        b.x = std::min(a.x, b.x);
+        b.sx = end - b.x;
+        return true;
+    }
+    if (a.x == b.x && a.sx == b.sx && a.y <= b.y + b.sy && b.y <= a.y + a.sy) {
+        double end = std::max(a.y + a.sy, b.y + b.sy);
+        b.y = std::min(a.y, b.y);
+        b.sy = end - b.y;
+        return true;
+    }
+    return false;
+}
+
+
+
+int coalesceForbiddenAreas(std::vector<ForbiddenAreaDescription> & areas)
+{
+    size_t count = areas.size();
+    std::vector<bool> removed(count, false);
+
+    // A merge can make the merged area contain or touch others already passed by the sweep, so sweep again
+    // until nothing changes.
+    bool merged = true;
+    while (merged) {
+        merged = false;
+
+        std::vector<size_t> order;
+        for (size_t i = 0; i < count; i++) {
+            if (!removed[i])
+                order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) { return areas[i].x < areas[j].x; });
+
+        // Areas whose x range reaches the start of the current one; only those can cover or touch it
+        std::vector<size_t> active;
+        for (size_t i : order) {
+            ForbiddenAreaDescription & area = areas[i];
+            active.erase(std::remove_if(active.begin(), active.end(), [&](size_t j) {
+                return removed[j] || areas[j].x + areas[j].sx < area.x;
+            }), active.end());
+
+            for (size_t j : active) {
+                if (contains(areas[j], area)) {
+                    removed[i] = true;
+                    break;
+                }
+                if (contains(area, areas[j])) {
+                    removed[j] = true;
+                } else if (merge(areas[j], area)) {
+                    removed[j] = true;
+                    merged = true;
+                }
+            }
+            if (!removed[i])
+                active.push_back(i);
+        }
+    }
+
+    // Keep the remaining areas in their original order
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!removed[i])
+            areas[kept++] = areas[i];
+    }
+    areas.resize(kept);
+    return count - kept;
+}
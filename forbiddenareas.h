@@ -0,0 +1,22 @@
+#ifndef FORBIDDENAREAS_H
+#define FORBIDDENAREAS_H
+
+#include <vector>
+#include "boarddescription.h"
+
+
+// Simplifies the forbidden areas of one side of a board without changing
+// the space they cover, so fewer cuboids have to be subtracted.
+//
+// All areas of a side reach up to the same height (through the case's
+// floor), so an area whose x/y rectangle lies within another, taller one
+// is dropped, and two areas of the same height whose rectangles form one
+// rectangle (same y range and touching or overlapping x ranges, or the
+// other way round) are merged. Candidate pairs are found by a sweep over
+// the x ranges. The remaining areas keep their original order.
+//
+// Returns the number of areas removed.
+int coalesceForbiddenAreas(std::vector<ForbiddenAreaDescription> & areas);
+
+
+#endif // FORBIDDENAREAS_H
@@ -1,6 +1,10 @@
 #ifndef GEOM_H
 #define GEOM_H
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 
 struct Point {
     double x, y;
@@ -54,4 +58,174 @@ inline Vec cross(const Vec & a, const Vec & b) {
     return {a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x};
 }
 
+inline double dot(const Vec & a, const Vec & b) {
+    return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+
+inline double length(const Vec & a) {
+    return std::sqrt(dot(a, a));
+}
+
+
+
+// Axis aligned bounding box. An empty box has min > max.
+struct Box {
+    Vec min = { HUGE_VAL,  HUGE_VAL,  HUGE_VAL};
+    Vec max = {-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+
+    bool empty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+    void extend(const Vec & p) {
+        min = {std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+        max = {std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+    }
+    void extend(const Box & b) {
+        if (!b.empty()) { extend(b.min); extend(b.max); }
+    }
+    // True if the interiors overlap (touching faces don't count)
+    bool overlaps(const Box & b) const {
+        return min.x < b.max.x && b.min.x < max.x
+            && min.y < b.max.y && b.min.y < max.y
+            && min.z < b.max.z && b.min.z < max.z;
+    }
+    Box intersection(const Box & b) const {
+        Box r;
+        r.min = {std::max(min.x, b.min.x), std::max(min.y, b.min.y), std::max(min.z, b.min.z)};
+        r.max = {std::min(max.x, b.max.x), std::min(max.y, b.max.y), std::min(max.z, b.max.z)};
+        return r;
+    }
+    bool contains(const Box & b) const {
+        return min.x <= b.min.x && b.max.x <= max.x
+            && min.y <= b.min.y && b.max.y <= max.y
+            && min.z <= b.min.z && b.max.z <= max.z;
+    }
+};
+
+
+
+// Affine transformation (3x4 matrix, the last row is implicitly 0 0 0 1).
+struct Matrix {
+    double m[3][4];
+
+    static Matrix identity() {
+        return {{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}};
+    }
+    static Matrix translation(double x, double y, double z) {
+        return {{{1, 0, 0, x}, {0, 1, 0, y}, {0, 0, 1, z}}};
+    }
+    static Matrix scaling(double x, double y, double z) {
+        return {{{x, 0, 0, 0}, {0, y, 0, 0}, {0, 0, z, 0}}};
+    }
+    // Rotation around the x / z axis, angle in degrees
+    static Matrix rotationX(double degrees) {
+        double c, s;
+        cosSin(degrees, c, s);
+        return {{{1, 0, 0, 0}, {0, c, -s, 0}, {0, s, c, 0}}};
+    }
+    static Matrix rotationZ(double degrees) {
+        double c, s;
+        cosSin(degrees, c, s);
+        return {{{c, -s, 0, 0}, {s, c, 0, 0}, {0, 0, 1, 0}}};
+    }
+    // Exact for multiples of 90 degrees (like OpenSCAD), so such rotations combine to matrices of 0 and +-1
+    static void cosSin(double degrees, double & c, double & s) {
+        double quarters = degrees / 90;
+        if (quarters == std::floor(quarters) && std::abs(quarters) < 1e9) {
+            static const double values[4][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+            int quarter = int(std::fmod(quarters, 4) + 4) % 4;
+            c = values[quarter][0];
+            s = values[quarter][1];
+            return;
+        }
+        c = std::cos(degrees * M_PI / 180);
+        s = std::sin(degrees * M_PI / 180);
+    }
+
+    bool isTranslation() const {
+        return m[0][0] == 1 && m[0][1] == 0 && m[0][2] == 0
+            && m[1][0] == 0 && m[1][1] == 1 && m[1][2] == 0
+            && m[2][0] == 0 && m[2][1] == 0 && m[2][2] == 1;
+    }
+
+    double determinant() const {
+        return m[0][0] * (m[1][1]*m[2][2] - m[1][2]*m[2][1])
+             - m[0][1] * (m[1][0]*m[2][2] - m[1][2]*m[2][0])
+             + m[0][2] * (m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+    }
+};
+
+// Transformation b followed by a
+inline Matrix operator*(const Matrix & a, const Matrix & b) {
+    Matrix r;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            r.m[i][j] = a.m[i][0]*b.m[0][j] + a.m[i][1]*b.m[1][j] + a.m[i][2]*b.m[2][j] + (j == 3 ? a.m[i][3] : 0);
+        }
+    }
+    return r;
+}
+
+inline Vec operator*(const Matrix & a, const Vec & v) {
+    return {a.m[0][0]*v.x + a.m[0][1]*v.y + a.m[0][2]*v.z + a.m[0][3],
+            a.m[1][0]*v.x + a.m[1][1]*v.y + a.m[1][2]*v.z + a.m[1][3],
+            a.m[2][0]*v.x + a.m[2][1]*v.y + a.m[2][2]*v.z + a.m[2][3]};
+}
+
+// Bounding box of the transformed box
+inline Box operator*(const Matrix & a, const Box & b) {
+    Box r;
+    if (b.empty())
+        return r;
+    for (int corner = 0; corner < 8; corner++) {
+        r.extend(a * Vec{(corner & 1) ? b.max.x : b.min.x,
+                         (corner & 2) ? b.max.y : b.min.y,
+                         (corner & 4) ? b.max.z : b.min.z});
+    }
+    return r;
+}
+
+
+
+// Convex hull of the points, counterclockwise (Andrew's monotone chain)
+inline std::vector<Point> convexHull(std::vector<Point> points) {
+    std::sort(points.begin(), points.end(), [](const Point & a, const Point & b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    if (points.size() < 3)
+        return points;
+    auto turn = [](const Point & o, const Point & a, const Point & b) {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    };
+    std::vector<Point> hull(2 * points.size());
+    size_t k = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        while (k >= 2 && turn(hull[k-2], hull[k-1], points[i]) <= 0)
+            k--;
+        hull[k++] = points[i];
+    }
+    for (size_t i = points.size() - 1, lower = k + 1; i > 0; i--) {
+        while (k >= lower && turn(hull[k-2], hull[k-1], points[i-1]) <= 0)
+            k--;
+        hull[k++] = points[i-1];
+    }
+    hull.resize(k - 1);
+    return hull;
+}
+
+// Area and perimeter of a polygon (area positive if counterclockwise)
+inline double polygonArea(const std::vector<Point> & polygon) {
+    double area = 0;
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+        area += polygon[j].x * polygon[i].y - polygon[i].x * polygon[j].y;
+    return area / 2;
+}
+
+inline double polygonPerimeter(const std::vector<Point> & polygon) {
+    double perimeter = 0;
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+        perimeter += std::hypot(polygon[i].x - polygon[j].x, polygon[i].y - polygon[j].y);
+    return perimeter;
+}
+
 #endif // GEOM_H
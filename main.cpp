@@ -1,56 +1,442 @@
-#include <fstream>
-#include <ooml/core/IndentWriter.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
 
 #include "casefactory.h"
-#include "board.h"
+#include "boardfile.h"
+#include "casejob.h"
+#include "clearance.h"
+#include "optimizer.h"
+#include "partcache.h"
+#include "renderer.h"
+#include "trace.h"
+#include "workpool.h"
 
-// Small helper function which writes the model to a file in SCAD format.
-void write(std::string fileName, const Component & model)
+void usage()
 {
-    std::cout << "Writing file " << fileName << " ... ";
+    std::cerr << "Usage: casefactory [--stl] [--3mf] [--inline] [--with-preview] [--cache=<dir>] [--trace=<file>] [--watch] [--<parameter>=<value> ...] <board file>" << std::endl
+              << "       casefactory [--stl] [--3mf] [--inline] [--with-preview] [--cache=<dir>] [--trace=<file>] [--<parameter>=<value> ...] --batch=<manifest> [--threads=<n>]" << std::endl
+              << "       casefactory --render [--openscad=<program>] [--threads=<n>] [--3mf] [--inline] [--with-preview] [--cache=<dir>] [--trace=<file>] [--<parameter>=<value> ...] (<board file> | --batch=<manifest>)" << std::endl
+              << "       casefactory --plate=<width>x<depth> [--copies=<n>] [--plate-gap=<mm>] [--inline] [--<parameter>=<value> ...] (<board file> | --batch=<manifest>)" << std::endl
+              << "       casefactory --check [--min-wall=<mm>] [--<parameter>=<value> ...] (<board file> | --batch=<manifest>)" << std::endl
+              << "       casefactory --optimize [--vary=<parameter>=<value>,...] [--min-wall=<mm>] [--min-floor=<mm>] [--<parameter>=<value> ...] <board file>" << std::endl
+              << std::endl
+              << "Generates <name>-case-bottom.scad, <name>-case-top.scad and <name>-case.scad for the board" << std::endl
+              << "described in the board file (see boardfile.h), or for all jobs listed in a batch manifest" << std::endl
+              << "(see casejob.h) using one worker thread per core. With --stl / --3mf, the parts are also" << std::endl
+              << "rendered to meshes in process and written as STL / 3MF files. Repeated subtrees are written" << std::endl
+              << "once as SCAD modules, unless --inline is given. With --cache, parts whose board and parameters" << std::endl
+              << "didn't change are taken from the cache directory instead of being generated again. With" << std::endl
+              << "--watch, the files are generated again each time the board file is saved, only for the" << std::endl
+              << "parts whose features changed. With --with-preview, the files are also written in preview" << std::endl
+              << "quality as <name>-preview-case-bottom.scad etc., before the final ones (not with --watch;" << std::endl
+              << "--preview=true gives all files in preview quality instead, see casefactory.h). With --trace," << std::endl
+              << "the time, CSG nodes, tree depth and bytes of each generation stage are recorded, written as" << std::endl
+              << "Chrome trace events (for chrome://tracing or Perfetto) to the given file and summed up per" << std::endl
+              << "stage at the end (not with --watch)." << std::endl
+              << std::endl
+              << "With --render, the parts are rendered to <name>-case-bottom.stl etc. by OpenSCAD (--openscad," << std::endl
+              << "default openscad) after all SCAD files are written, up to --threads (one per core) at once," << std::endl
+              << "and the combined <name>-case.scad isn't written. Files with the same bytes are rendered only" << std::endl
+              << "once, and with --cache, not again in later runs." << std::endl
+              << std::endl
+              << "With --plate, both parts of each case (--copies times) are packed onto print beds of the" << std::endl
+              << "given size in mm, at least --plate-gap (5 mm) apart, and written as <name>-plate-1.scad, ...," << std::endl
+              << "one file per bed next to the case files (with --batch, plate-1.scad, ... in the directory" << std::endl
+              << "the outputs of all jobs have in common)." << std::endl
+              << std::endl
+              << "With --check, nothing is generated. Instead, the board (or all jobs of the manifest) is checked" << std::endl
+              << "for holes cutting into screw enclosures, ports cutting through wall supports, walls (also of" << std::endl
+              << "wall supports beside ports) thinner than --min-wall and features breaking through the case" << std::endl
+              << "(see clearance.h). The issues are printed as JSON, and the exit code is 1 if there are any." << std::endl
+              << std::endl
+              << "With --optimize, nothing is generated. Instead, all combinations of the --vary values (by" << std::endl
+              << "default a few values for walls, floors, space, the screw hole enclosures, the smaller" << std::endl
+              << "heights and the corner radius) are measured analytically, and the ones with the least" << std::endl
+              << "material for their outer size are printed which leave walls of at least --min-wall (1.2 mm)" << std::endl
+              << "at the corners and ports, and a floor of at least --min-floor (0.8 mm) beneath the board." << std::endl
+              << std::endl
+              << "The case parameters can be overridden:" << std::endl;
+    for (auto name : CaseFactory::parameterNames())
+        std::cerr << "  --" << name << "=<value>" << std::endl;
+}
+
 
-    IndentWriter writer;
-    writer << model;
+// Reads a finite decimal number (like "1.5" or "-2e3"), false if the text is anything else, also "nan" or "inf"
+static bool parseNumber(const std::string & text, double & value)
+{
+    char * end;
+    double d = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end || !std::isfinite(d))
+        return false;
+    value = d;
+    return true;
+}
 
-    std::ofstream outFile;
-    outFile.open(fileName);
-    outFile << writer;
 
-    std::cout << "done" << std::endl;
+// Reads a whole non-negative integer, false if the text is anything else
+static bool parseCount(const std::string & text, unsigned & value)
+{
+    char * end;
+    long n = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end || n < 0 || n > long(std::numeric_limits<unsigned>::max()))
+        return false;
+    value = unsigned(n);
+    return true;
 }
 
 
-int main()
+// Runs all jobs of a manifest on a work pool and reports the time of each job.
+int runBatch(const std::string & manifest, const CaseJob & options, unsigned threadCount)
 {
-    BoardDescription board = makeNamedBoard();
+    std::vector<CaseJob> jobs;
+    std::string error;
+    if (!readManifest(manifest, jobs, error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
 
-    // Create a factory to build a case for this board.
-    CaseFactory factory(board);
+    typedef std::chrono::steady_clock Clock;
+    auto seconds = [](Clock::time_point since) {
+        return std::chrono::duration<double>(Clock::now() - since).count();
+    };
+
+    WorkPool pool(threadCount);
+    std::cout << "Running " << jobs.size() << " jobs on " << pool.threadCount() << " threads" << std::endl;
+
+    Clock::time_point batchStart = Clock::now();
+    std::mutex outputMutex;
+    int done = 0;
+    int failed = 0;
+    std::vector<std::vector<std::string>> partFiles(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        CaseJob & job = jobs[i];
+        // Command line parameters come first, so the manifest can override them
+        job.parameters.insert(job.parameters.begin(), options.parameters.begin(), options.parameters.end());
+        job.stl = options.stl;
+        job.threeMf = options.threeMf;
+        job.sharedModules = options.sharedModules;
+        job.preview = options.preview;
+        job.combined = options.combined;
+        job.cache = options.cache;
+        job.partFiles = options.partFiles ? &partFiles[i] : nullptr;
+        // With enough jobs to keep all threads busy, meshing each part in parallel doesn't help
+        job.parallelMesh = jobs.size() < pool.threadCount();
 
-    // Now we can fine-tune some dimension parameters for the case model. See the class CaseFactory for more options, such as wall thickness, screw hole radius etc.
-    factory.smallerBottomHeight = .5; // We want the bottom part to be a bit less high (so the GPIO pin ends will be within the floor; this is just to demonstrate the power of the feature "forbidden areas")
+        pool.submit([&, job] {
+            Clock::time_point start = Clock::now();
+            std::ostringstream log;
+            std::string error;
+            bool ok = runCaseJob(job, log, error);
+            double time = seconds(start);
 
-    // You can set some print settings which will help the factory to optimize print results.
-    factory.printLayerHeight = .2;
-    factory.printSafeBridgeLayerCount = 3;
+            // Print the output of each job in one piece
+            std::lock_guard<std::mutex> lock(outputMutex);
+            done++;
+            if (!ok)
+                failed++;
+            std::cout << "[" << done << "/" << jobs.size() << "] " << caseJobLabel(job)
+                      << " -> " << job.outputDir << ": " << (ok ? "ok" : "FAILED") << ", "
+                      << std::fixed << std::setprecision(3) << time << " s" << std::endl;
+            if (!ok)
+                std::cout << "  " << error << std::endl;
+        });
+    }
+    pool.wait();
 
+    // In the order of the manifest, whichever job finished first
+    if (options.partFiles) {
+        for (auto & files : partFiles)
+            options.partFiles->insert(options.partFiles->end(), files.begin(), files.end());
+    }
 
-    // Generate the models
-    Component bottom = factory.constructBottom();
-    Component top = factory.constructTop();
+    std::cout << jobs.size() - failed << " of " << jobs.size() << " jobs succeeded in "
+              << std::fixed << std::setprecision(3) << seconds(batchStart) << " s" << std::endl;
+    return failed ? 1 : 0;
+}
 
 
-    // Write these models to SCAD files. We generate 3 files.
-    // 1) Only the bottom:
-    write(board.name + "-case-bottom.scad", bottom);
-    // 2) Only the top:
-    write(board.name + "-case-top.scad", top);
-    // 3) Both parts side by side:
-    double distance = 5; // mm
-    double offset = factory.outerDimensions().y + distance;
-    write(board.name + "-case.scad", bottom + top.translatedCopy(0, offset, 0));
+// Checks the boards of all jobs and prints the issues as JSON. Returns 1 if there are any.
+int runCheck(const std::vector<CaseJob> & jobs, double minWall)
+{
+    std::ostream & json = std::cout;
+    json << "{\n  \"minWall\": " << minWall << ",\n  \"boards\": [";
+    size_t issueCount = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const CaseJob & job = jobs[i];
+        std::vector<CaseIssue> issues;
+        BoardDescription board;
+        std::string error;
+        if (readBoardFile(job.boardFile, board, error)) {
+            CaseFactory factory(board);
+            if (!configureFactory(factory, job.parameters, error)) {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+            issues = checkCase(board, factory, minWall);
+        } else {
+            CaseIssue issue;
+            issue.kind = CaseIssue::InvalidBoard;
+            issue.feature = "board";
+            issue.message = error;
+            issues.push_back(issue);
+        }
+        issueCount += issues.size();
 
-    return 0;
+        json << (i ? ",\n" : "\n") << "    {\"boardFile\": " << jsonString(job.boardFile)
+             << ", \"label\": " << jsonString(caseJobLabel(job)) << ", \"issues\": ";
+        writeCaseIssues(json, issues, "      ");
+        json << "}";
+    }
+    json << "\n  ],\n  \"issues\": " << issueCount << "\n}" << std::endl;
+    return issueCount ? 1 : 0;
 }
 
 
+// Searches the Pareto-best parameters for the board of the job and prints them.
+int runOptimizer(const CaseJob & job, ParameterVariations variations, const OptimizerConstraints & constraints)
+{
+    BoardDescription board;
+    std::string error;
+    if (!readBoardFile(job.boardFile, board, error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    CaseFactory factory(board);
+    if (!configureFactory(factory, job.parameters, error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    // Parameters set explicitly are not varied by default
+    if (variations.empty()) {
+        for (auto variation : defaultOptimizerVariations()) {
+            if (std::none_of(job.parameters.begin(), job.parameters.end(),
+                             [&](const std::pair<std::string, std::string> & p) { return p.first == variation.first; }))
+                variations.push_back(variation);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<OptimizerResult> results;
+    size_t evaluated;
+    if (!optimizeParameters(factory, variations, constraints, results, evaluated, error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Measured " << evaluated << " parameter sets in " << std::fixed << std::setprecision(3) << seconds
+              << " s (" << std::setprecision(0) << evaluated / seconds << " per second), "
+              << results.size() << " Pareto-optimal:" << std::endl;
+    for (const OptimizerResult & result : results) {
+        const CaseMeasures & m = result.measures;
+        std::cout << std::setprecision(2) << std::setw(7) << m.material / 1e3 << " cm3  "
+                  << std::setprecision(1) << m.outer.x << " x " << m.outer.y << " x " << m.outer.z << " mm  "
+                  << "wall " << std::setprecision(2) << m.thinnestWall << "  floor " << m.thinnestFloor << " ";
+        for (auto parameter : result.parameters)
+            std::cout << " --" << parameter.first << "=" << parameter.second;
+        std::cout << std::endl;
+    }
+    if (results.empty())
+        std::cout << "No parameter set fulfills the constraints." << std::endl;
+    return results.empty() ? 1 : 0;
+}
+
+
+// Prints the summary of the stages traced so far and writes them to the file (see --trace)
+bool finishTrace(const std::string & fileName)
+{
+    std::cout << std::endl;
+    Trace::printSummary(std::cout);
+    if (!Trace::writeJson(fileName)) {
+        std::cerr << "cannot write the trace to " << fileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+int main(int argc, char * argv[])
+{
+    std::string manifest;
+    std::string cacheDir;
+    std::string traceFile;
+    RenderOptions renderOptions;
+    bool render = false;
+    bool watch = false;
+    bool optimize = false;
+    bool check = false;
+    bool plates = false;
+    PlateJob plate;
+    ParameterVariations variations;
+    OptimizerConstraints constraints;
+    unsigned threadCount = 0;
+    CaseJob job;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t equals = arg.find('=');
+        if (arg == "--stl") {
+            job.stl = true;
+        } else if (arg == "--3mf") {
+            job.threeMf = true;
+        } else if (arg == "--inline") {
+            job.sharedModules = false;
+        } else if (arg == "--with-preview") {
+            job.preview = true;
+        } else if (arg == "--render") {
+            render = true;
+        } else if (arg.compare(0, 11, "--openscad=") == 0) {
+            renderOptions.openscad = arg.substr(11);
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--check") {
+            check = true;
+        } else if (arg == "--optimize") {
+            optimize = true;
+        } else if (arg.compare(0, 7, "--vary=") == 0 && arg.find('=', 7) != std::string::npos) {
+            size_t valuesStart = arg.find('=', 7) + 1;
+            std::vector<std::string> values;
+            std::istringstream list(arg.substr(valuesStart));
+            for (std::string value; std::getline(list, value, ','); )
+                values.push_back(value);
+            variations.push_back({arg.substr(7, valuesStart - 8), values});
+        } else if (arg.compare(0, 11, "--min-wall=") == 0) {
+            if (!parseNumber(arg.substr(11), constraints.minWall)) {
+                usage();
+                return 1;
+            }
+        } else if (arg.compare(0, 12, "--min-floor=") == 0) {
+            if (!parseNumber(arg.substr(12), constraints.minFloor)) {
+                usage();
+                return 1;
+            }
+        } else if (arg.compare(0, 8, "--plate=") == 0 && arg.find('x', 8) != std::string::npos) {
+            plates = true;
+            size_t x = arg.find('x', 8);
+            if (!parseNumber(arg.substr(8, x - 8), plate.bedWidth) || !parseNumber(arg.substr(x + 1), plate.bedDepth)) {
+                usage();
+                return 1;
+            }
+        } else if (arg.compare(0, 9, "--copies=") == 0) {
+            unsigned copies;
+            if (!parseCount(arg.substr(9), copies) || copies > unsigned(std::numeric_limits<int>::max())) {
+                usage();
+                return 1;
+            }
+            plate.copies = copies;
+        } else if (arg.compare(0, 12, "--plate-gap=") == 0) {
+            if (!parseNumber(arg.substr(12), plate.gap)) {
+                usage();
+                return 1;
+            }
+        } else if (arg.compare(0, 8, "--cache=") == 0) {
+            cacheDir = arg.substr(8);
+        } else if (arg.compare(0, 8, "--trace=") == 0) {
+            traceFile = arg.substr(8);
+        } else if (arg.compare(0, 8, "--batch=") == 0) {
+            manifest = arg.substr(8);
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            if (!parseCount(arg.substr(10), threadCount)) {
+                usage();
+                return 1;
+            }
+        } else if (arg.compare(0, 2, "--") == 0 && equals != std::string::npos) {
+            job.parameters.push_back({arg.substr(2, equals - 2), arg.substr(equals + 1)});
+        } else if (arg.compare(0, 1, "-") != 0 && job.boardFile.empty()) {
+            job.boardFile = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (job.boardFile.empty() == manifest.empty() || ((watch || optimize) && !manifest.empty()) || watch + optimize + check + plates > 1 ||
+            (!traceFile.empty() && (watch || optimize || check)) || (job.preview && (watch || optimize || check || plates)) ||
+            (render && (job.stl || watch || optimize || check || plates)) ||
+            (plates && (plate.bedWidth <= 0 || plate.bedDepth <= 0 || plate.copies < 1 || plate.gap < 0))) {
+        usage();
+        return 1;
+    }
+
+    if (optimize)
+        return runOptimizer(job, variations, constraints);
+    if (check || plates) {
+        std::vector<CaseJob> jobs;
+        std::string error;
+        if (manifest.empty()) {
+            jobs.push_back(job);
+        } else if (!readManifest(manifest, jobs, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        // Command line parameters come first, so the manifest can override them
+        for (CaseJob & manifestJob : jobs) {
+            if (!manifest.empty())
+                manifestJob.parameters.insert(manifestJob.parameters.begin(), job.parameters.begin(), job.parameters.end());
+        }
+        if (check)
+            return runCheck(jobs, constraints.minWall);
+
+        if (!traceFile.empty())
+            Trace::enable();
+        plate.sharedModules = job.sharedModules;
+        int result = 0;
+        if (!writePlates(jobs, plate, std::cout, error)) {
+            std::cerr << error << std::endl;
+            result = 1;
+        }
+        if (!traceFile.empty() && !finishTrace(traceFile))
+            result = 1;
+        return result;
+    }
+
+    std::unique_ptr<PartCache> cache;
+    if (!cacheDir.empty()) {
+        cache.reset(new PartCache(cacheDir));
+        job.cache = cache.get();
+    }
+    if (!traceFile.empty())
+        Trace::enable();
+
+    // Rendering comes after all files are written, so only the parts are needed
+    std::vector<std::string> partFiles;
+    if (render) {
+        job.partFiles = &partFiles;
+        job.combined = false;
+    }
+
+    int result = 0;
+    std::string error;
+    if (!manifest.empty()) {
+        result = runBatch(manifest, job, threadCount);
+    } else if (watch) {
+        watchCaseJob(job, std::cout, error);
+        std::cerr << error << std::endl;
+        result = 1;
+    } else if (!runCaseJob(job, std::cout, error)) {
+        std::cerr << error << std::endl;
+        result = 1;
+    }
+
+    if (render && !partFiles.empty()) {
+        renderOptions.jobs = threadCount;
+        renderOptions.cache = cache.get();
+        std::cout << std::endl;
+        if (!renderScadFiles(partFiles, renderOptions, std::cout, error)) {
+            std::cerr << error << std::endl;
+            result = 1;
+        }
+    }
+
+    if (cache)
+        std::cout << "Cache: " << cache->hits() << " hits, " << cache->misses() << " misses" << std::endl;
+    if (!traceFile.empty() && !finishTrace(traceFile))
+        result = 1;
+    return result;
+}
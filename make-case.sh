@@ -3,22 +3,19 @@
 cd "$(dirname "$0")"
 
 name="${1%.h}"
+name="${name%.board}"
+shift
 header="$name.h"
+boardfile="$name.board"
 
-if [ ! -f "$header" ]; then
-    echo "Header file '$header' not found"
+# With a header, make regenerates the board file whenever the header is newer
+if [ -f "$header" ]; then
+    make "$boardfile" || exit 1
+elif [ ! -f "$boardfile" ]; then
+    echo "Neither board file '$boardfile' nor header file '$header' found"
     exit 1
 fi
 
-cat <<BOARD > board.h
-#include "$header"
-
-BoardDescription makeNamedBoard() {
-    BoardDescription b = makeBoard();
-    b.name = "$name";
-    return b;
-}
-BOARD
-
-make
-./casefactory
+make || exit 1
+# Any further arguments are passed on, e.g. --space=.4
+./casefactory "$@" "$boardfile"
@@ -0,0 +1,883 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <future>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+
+
+// Tolerance for classifying points against planes (mm)
+static const double planeEpsilon = 1e-5;
+
+// Distance below which vertices are merged for export (mm). Somewhat larger than planeEpsilon, as points
+// computed on both sides of a split can be apart by a little more than the tolerance they were split with.
+static const double weldEpsilon = 1e-4;
+
+
+
+static Vec normalized(const Vec & v)
+{
+    double l = length(v);
+    return l > 0 ? v / l : v;
+}
+
+
+Polygon::Polygon(std::vector<Vec> vertices) :
+    vertices(std::move(vertices))
+{
+    // Newell's method, robust for slightly non-planar or nearly degenerate polygons
+    Vec n = {0, 0, 0};
+    Vec center = {0, 0, 0};
+    for (size_t i = 0; i < this->vertices.size(); i++) {
+        const Vec & a = this->vertices[i];
+        const Vec & b = this->vertices[(i + 1) % this->vertices.size()];
+        n += Vec{(a.y - b.y) * (a.z + b.z), (a.z - b.z) * (a.x + b.x), (a.x - b.x) * (a.y + b.y)};
+        center += a;
+    }
+    normal = normalized(n);
+    w = dot(normal, center / this->vertices.size());
+}
+
+
+Polygon::Polygon(std::vector<Vec> vertices, const Vec & normal, double w) :
+    vertices(std::move(vertices)), normal(normal), w(w)
+{
+}
+
+
+void Polygon::flip()
+{
+    std::reverse(vertices.begin(), vertices.end());
+    normal = normal * -1.0;
+    w = -w;
+}
+
+
+Box Mesh::bounds() const
+{
+    Box box;
+    for (const Polygon & polygon : polygons)
+        for (const Vec & v : polygon.vertices)
+            box.extend(v);
+    return box;
+}
+
+
+size_t Mesh::triangleCount() const
+{
+    size_t count = 0;
+    for (const Polygon & polygon : polygons)
+        count += polygon.vertices.size() - 2;
+    return count;
+}
+
+
+
+// BSP BOOLEANS
+
+namespace {
+
+enum { Coplanar = 0, Front = 1, Back = 2, Spanning = 3 };
+
+// Splits the polygon by the plane dot(n, p) == w and puts the pieces into the lists.
+// Coplanar polygons go into coplanarFront or coplanarBack depending on their orientation.
+void splitPolygon(const Vec & n, double w, const Polygon & polygon,
+                  std::vector<Polygon> & coplanarFront, std::vector<Polygon> & coplanarBack,
+                  std::vector<Polygon> & front, std::vector<Polygon> & back)
+{
+    int polygonType = 0;
+    std::vector<int> types(polygon.vertices.size());
+    for (size_t i = 0; i < polygon.vertices.size(); i++) {
+        double t = dot(n, polygon.vertices[i]) - w;
+        types[i] = (t < -planeEpsilon) ? Back : (t > planeEpsilon) ? Front : Coplanar;
+        polygonType |= types[i];
+    }
+
+    switch (polygonType) {
+    case Coplanar:
+        (dot(n, polygon.normal) > 0 ? coplanarFront : coplanarBack).push_back(polygon);
+        break;
+    case Front:
+        front.push_back(polygon);
+        break;
+    case Back:
+        back.push_back(polygon);
+        break;
+    case Spanning: {
+        std::vector<Vec> f, b;
+        size_t count = polygon.vertices.size();
+        for (size_t i = 0; i < count; i++) {
+            size_t j = (i + 1) % count;
+            const Vec & vi = polygon.vertices[i];
+            const Vec & vj = polygon.vertices[j];
+            if (types[i] != Back)  f.push_back(vi);
+            if (types[i] != Front) b.push_back(vi);
+            if ((types[i] | types[j]) == Spanning) {
+                double t = (w - dot(n, vi)) / dot(n, vj - vi);
+                Vec v = vi + (vj - vi) * t;
+                f.push_back(v);
+                b.push_back(v);
+            }
+        }
+        if (f.size() >= 3) front.push_back(Polygon(f, polygon.normal, polygon.w));
+        if (b.size() >= 3) back.push_back(Polygon(b, polygon.normal, polygon.w));
+        break;
+    }
+    }
+}
+
+
+// Node of a BSP tree. The polygons are those lying in the plane of the node.
+struct BspNode {
+    bool hasPlane = false;
+    Vec normal;
+    double w;
+    std::vector<Polygon> polygons;
+    std::unique_ptr<BspNode> front;
+    std::unique_ptr<BspNode> back;
+
+    explicit BspNode(std::vector<Polygon> list) { build(std::move(list)); }
+
+    // Inverts the solid (inside <-> outside)
+    void invert() {
+        for (Polygon & p : polygons)
+            p.flip();
+        normal = normal * -1.0;
+        w = -w;
+        if (front) front->invert();
+        if (back) back->invert();
+        std::swap(front, back);
+    }
+
+    // Removes all parts of the list which are inside this solid
+    std::vector<Polygon> clipPolygons(const std::vector<Polygon> & list) const {
+        if (!hasPlane)
+            return list;
+        std::vector<Polygon> f, b;
+        for (const Polygon & p : list)
+            splitPolygon(normal, w, p, f, b, f, b);
+        if (front)
+            f = front->clipPolygons(f);
+        if (back) {
+            b = back->clipPolygons(b);
+            f.insert(f.end(), b.begin(), b.end());
+        }
+        return f;
+    }
+
+    // Removes all parts of this tree's polygons which are inside the other solid
+    void clipTo(const BspNode & other) {
+        polygons = other.clipPolygons(polygons);
+        if (front) front->clipTo(other);
+        if (back) back->clipTo(other);
+    }
+
+    void allPolygons(std::vector<Polygon> & list) const {
+        list.insert(list.end(), polygons.begin(), polygons.end());
+        if (front) front->allPolygons(list);
+        if (back) back->allPolygons(list);
+    }
+
+    void build(std::vector<Polygon> list) {
+        if (list.empty())
+            return;
+        if (!hasPlane) {
+            hasPlane = true;
+            normal = list[0].normal;
+            w = list[0].w;
+        }
+        std::vector<Polygon> f, b;
+        for (const Polygon & p : list)
+            splitPolygon(normal, w, p, polygons, polygons, f, b);
+        if (!f.empty()) {
+            if (front) front->build(std::move(f));
+            else front.reset(new BspNode(std::move(f)));
+        }
+        if (!b.empty()) {
+            if (back) back->build(std::move(b));
+            else back.reset(new BspNode(std::move(b)));
+        }
+    }
+};
+
+} // namespace
+
+
+// Whether the boxes overlap or touch. Operands which only touch have to be united by the BSP trees as well,
+// or the faces where they touch would stay inside the mesh.
+static bool touches(const Box & a, const Box & b)
+{
+    return a.min.x <= b.max.x && b.min.x <= a.max.x
+        && a.min.y <= b.max.y && b.min.y <= a.max.y
+        && a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+
+Mesh meshUnion(Mesh a, Mesh b)
+{
+    if (!touches(a.bounds(), b.bounds())) {
+        a.polygons.insert(a.polygons.end(), b.polygons.begin(), b.polygons.end());
+        return a;
+    }
+    BspNode na(std::move(a.polygons));
+    BspNode nb(std::move(b.polygons));
+    na.clipTo(nb);
+    nb.clipTo(na);
+    nb.invert();
+    nb.clipTo(na);
+    nb.invert();
+    std::vector<Polygon> rest;
+    nb.allPolygons(rest);
+    na.build(rest);
+
+    Mesh result;
+    na.allPolygons(result.polygons);
+    return result;
+}
+
+
+Mesh meshDifference(Mesh a, Mesh b)
+{
+    if (!a.bounds().overlaps(b.bounds()))
+        return a;
+    BspNode na(std::move(a.polygons));
+    BspNode nb(std::move(b.polygons));
+    na.invert();
+    na.clipTo(nb);
+    nb.clipTo(na);
+    nb.invert();
+    nb.clipTo(na);
+    nb.invert();
+    std::vector<Polygon> rest;
+    nb.allPolygons(rest);
+    na.build(rest);
+    na.invert();
+
+    Mesh result;
+    na.allPolygons(result.polygons);
+    return result;
+}
+
+
+Mesh meshIntersection(Mesh a, Mesh b)
+{
+    if (!a.bounds().overlaps(b.bounds()))
+        return Mesh();
+    BspNode na(std::move(a.polygons));
+    BspNode nb(std::move(b.polygons));
+    na.invert();
+    nb.clipTo(na);
+    nb.invert();
+    na.clipTo(nb);
+    nb.clipTo(na);
+    std::vector<Polygon> rest;
+    nb.allPolygons(rest);
+    na.build(rest);
+    na.invert();
+
+    Mesh result;
+    na.allPolygons(result.polygons);
+    return result;
+}
+
+
+
+// CONVEX HULL
+
+Mesh meshHull(const Mesh & mesh)
+{
+    std::vector<Vec> points;
+    for (const Polygon & polygon : mesh.polygons)
+        points.insert(points.end(), polygon.vertices.begin(), polygon.vertices.end());
+    if (points.size() < 4)
+        return Mesh();
+
+    Box box = mesh.bounds();
+    double eps = 1e-9 * std::max(1.0, length(box.max - box.min));
+
+    // Initial tetrahedron from extreme points
+    size_t i0 = 0, i1 = 0, i2 = 0, i3 = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (points[i].x < points[i0].x) i0 = i;
+    }
+    double best = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        double d = length(points[i] - points[i0]);
+        if (d > best) { best = d; i1 = i; }
+    }
+    best = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        double d = length(cross(points[i1] - points[i0], points[i] - points[i0]));
+        if (d > best) { best = d; i2 = i; }
+    }
+    Vec n0 = cross(points[i1] - points[i0], points[i2] - points[i0]);
+    best = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        double d = std::abs(dot(n0, points[i] - points[i0]));
+        if (d > best) { best = d; i3 = i; }
+    }
+    if (best <= eps * length(n0))
+        return Mesh(); // flat
+
+    struct Face {
+        size_t a, b, c;
+        Vec normal;
+        double w;
+    };
+    std::vector<Face> faces;
+    auto addFace = [&](size_t a, size_t b, size_t c) {
+        Vec n = normalized(cross(points[b] - points[a], points[c] - points[a]));
+        faces.push_back({a, b, c, n, dot(n, points[a])});
+    };
+    if (dot(n0, points[i3] - points[i0]) > 0) std::swap(i1, i2);
+    addFace(i0, i1, i2);
+    addFace(i0, i3, i1);
+    addFace(i1, i3, i2);
+    addFace(i2, i3, i0);
+
+    // Add the points one by one, replacing all faces visible from the point by a fan to the horizon
+    for (size_t p = 0; p < points.size(); p++) {
+        std::vector<bool> visible(faces.size());
+        bool any = false;
+        for (size_t f = 0; f < faces.size(); f++) {
+            visible[f] = dot(faces[f].normal, points[p]) - faces[f].w > eps;
+            any = any || visible[f];
+        }
+        if (!any)
+            continue;
+
+        std::map<std::pair<size_t, size_t>, int> edges;
+        for (size_t f = 0; f < faces.size(); f++) {
+            if (!visible[f]) continue;
+            edges[{faces[f].a, faces[f].b}]++;
+            edges[{faces[f].b, faces[f].c}]++;
+            edges[{faces[f].c, faces[f].a}]++;
+        }
+        std::vector<Face> kept;
+        for (size_t f = 0; f < faces.size(); f++)
+            if (!visible[f]) kept.push_back(faces[f]);
+        faces.swap(kept);
+        for (auto edge : edges) {
+            // Horizon edge: its reverse belongs to a face that stays
+            if (!edges.count({edge.first.second, edge.first.first}))
+                addFace(edge.first.first, edge.first.second, p);
+        }
+    }
+
+    Mesh hull;
+    for (const Face & f : faces)
+        hull.polygons.push_back(Polygon({points[f.a], points[f.b], points[f.c]}, f.normal, f.w));
+    return hull;
+}
+
+
+
+// TRIANGULATION
+
+namespace {
+
+// Gives points closer than weldEpsilon the same vertex, using a grid of cells of twice that size
+class VertexWelder
+{
+public:
+    explicit VertexWelder(std::vector<Vec> & vertices) : vertices(vertices) {}
+
+    uint32_t index(const Vec & v) {
+        Cell c = {cell(v.x), cell(v.y), cell(v.z)};
+        for (int64_t x = c.x - 1; x <= c.x + 1; x++) {
+            for (int64_t y = c.y - 1; y <= c.y + 1; y++) {
+                for (int64_t z = c.z - 1; z <= c.z + 1; z++) {
+                    auto found = cells.find({x, y, z});
+                    if (found == cells.end())
+                        continue;
+                    for (uint32_t i : found->second) {
+                        if (length(vertices[i] - v) <= weldEpsilon)
+                            return i;
+                    }
+                }
+            }
+        }
+        uint32_t i = vertices.size();
+        vertices.push_back(v);
+        cells[c].push_back(i);
+        return i;
+    }
+
+private:
+    struct Cell {
+        int64_t x, y, z;
+        bool operator==(const Cell & c) const { return x == c.x && y == c.y && z == c.z; }
+    };
+    struct CellHash {
+        size_t operator()(const Cell & c) const {
+            return std::hash<int64_t>()((c.x * 73856093) ^ (c.y * 19349663) ^ (c.z * 83492791));
+        }
+    };
+
+    static int64_t cell(double value) {
+        return int64_t(std::floor(value / (2 * weldEpsilon)));
+    }
+
+    std::vector<Vec> & vertices;
+    std::unordered_map<Cell, std::vector<uint32_t>, CellHash> cells;
+};
+
+
+double coordinate(const Vec & v, int axis)
+{
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+
+// The vertices sorted along each axis, to find the ones near an edge
+class VertexIndex
+{
+public:
+    explicit VertexIndex(const std::vector<Vec> & vertices) : vertices(vertices) {
+        for (int axis = 0; axis < 3; axis++) {
+            order[axis].resize(vertices.size());
+            for (uint32_t i = 0; i < vertices.size(); i++)
+                order[axis][i] = i;
+            std::sort(order[axis].begin(), order[axis].end(), [&](uint32_t a, uint32_t b) {
+                return coordinate(vertices[a], axis) < coordinate(vertices[b], axis);
+            });
+        }
+    }
+
+    // Calls f with each vertex in the bounding box of the edge (plus the tolerance). Only the vertices in
+    // the range along the axis where the edge is shortest are visited, so axis aligned edges are cheap.
+    template <typename F>
+    void nearEdge(const Vec & a, const Vec & b, F f) const {
+        Box box;
+        box.extend(a);
+        box.extend(b);
+        box.min -= Vec{weldEpsilon, weldEpsilon, weldEpsilon};
+        box.max += Vec{weldEpsilon, weldEpsilon, weldEpsilon};
+        Vec size = box.max - box.min;
+        int axis = (size.x <= size.y && size.x <= size.z) ? 0 : (size.y <= size.z) ? 1 : 2;
+
+        const std::vector<uint32_t> & sorted = order[axis];
+        auto first = std::lower_bound(sorted.begin(), sorted.end(), coordinate(box.min, axis),
+                                      [&](uint32_t i, double value) { return coordinate(vertices[i], axis) < value; });
+        for (auto i = first; i != sorted.end() && coordinate(vertices[*i], axis) <= coordinate(box.max, axis); ++i) {
+            const Vec & v = vertices[*i];
+            if (v.x >= box.min.x && v.x <= box.max.x && v.y >= box.min.y && v.y <= box.max.y &&
+                    v.z >= box.min.z && v.z <= box.max.z)
+                f(*i);
+        }
+    }
+
+private:
+    const std::vector<Vec> & vertices;
+    std::vector<uint32_t> order[3];
+};
+
+
+// Distance of p from the line through a and b
+double lineDistance(const Vec & p, const Vec & a, const Vec & b)
+{
+    double l = length(b - a);
+    return l > 0 ? length(cross(b - a, p - a)) / l : length(p - a);
+}
+
+// Triangulates the convex loop. It fans from a corner whose sides weren't split, as those would give
+// triangles without area. If there is none, it fans from the center instead. If the loop is flat (all
+// points on a line), it only gets triangles if keepFlat is set.
+void addFan(const std::vector<uint32_t> & loop, bool keepFlat, std::vector<Vec> & vertices,
+            std::vector<std::array<uint32_t, 3>> & triangles)
+{
+    size_t n = loop.size();
+    std::vector<bool> corner(n);
+    size_t corners = 0;
+    for (size_t k = 0; k < n; k++) {
+        const Vec & previous = vertices[loop[(k + n - 1) % n]];
+        const Vec & next = vertices[loop[(k + 1) % n]];
+        corner[k] = lineDistance(vertices[loop[k]], previous, next) > weldEpsilon;
+        corners += corner[k];
+    }
+    if (corners < 3 && !keepFlat)
+        return;
+    size_t apex = (corners < 3) ? 0 : n;
+    for (size_t k = 0; k < n && apex == n; k++) {
+        if (corner[(k + n - 1) % n] && corner[k] && corner[(k + 1) % n])
+            apex = k;
+    }
+    if (apex < n) {
+        for (size_t k = 1; k + 1 < n; k++)
+            triangles.push_back({loop[apex], loop[(apex + k) % n], loop[(apex + k + 1) % n]});
+    } else {
+        Vec center = {0, 0, 0};
+        for (size_t k = 0; k < n; k++) {
+            if (corner[k])
+                center += vertices[loop[k]];
+        }
+        uint32_t c = vertices.size();
+        vertices.push_back(center / corners);
+        for (size_t k = 0; k < n; k++)
+            triangles.push_back({c, loop[k], loop[(k + 1) % n]});
+    }
+}
+
+
+// Directed edge as a number
+uint64_t edgeKey(uint32_t a, uint32_t b)
+{
+    return (uint64_t(a) << 32) | b;
+}
+
+
+// How often each directed edge is used
+std::unordered_map<uint64_t, int> edgeUses(const std::vector<std::array<uint32_t, 3>> & triangles)
+{
+    std::unordered_map<uint64_t, int> uses;
+    for (const auto & t : triangles) {
+        for (int k = 0; k < 3; k++)
+            uses[edgeKey(t[k], t[(k + 1) % 3])]++;
+    }
+    return uses;
+}
+
+} // namespace
+
+
+TriangleMesh triangulate(const Mesh & mesh)
+{
+    TriangleMesh result;
+    std::vector<Vec> & vertices = result.vertices;
+
+    // Weld the vertices
+    VertexWelder welder(vertices);
+    std::vector<std::vector<uint32_t>> loops;
+    for (const Polygon & polygon : mesh.polygons) {
+        std::vector<uint32_t> loop;
+        for (const Vec & v : polygon.vertices) {
+            uint32_t i = welder.index(v);
+            if (loop.empty() || loop.back() != i)
+                loop.push_back(i);
+        }
+        while (loop.size() > 1 && loop.front() == loop.back())
+            loop.pop_back();
+        if (loop.size() >= 3)
+            loops.push_back(std::move(loop));
+    }
+
+    VertexIndex index(vertices);
+    for (const std::vector<uint32_t> & loop : loops) {
+        // Split the edges at the vertices lying on them
+        std::vector<uint32_t> split;
+        for (size_t k = 0; k < loop.size(); k++) {
+            uint32_t a = loop[k], b = loop[(k + 1) % loop.size()];
+            const Vec & va = vertices[a];
+            Vec edge = vertices[b] - va;
+            std::vector<std::pair<double, uint32_t>> inner;
+            index.nearEdge(va, vertices[b], [&](uint32_t i) {
+                double t = dot(vertices[i] - va, edge) / dot(edge, edge);
+                if (i != a && i != b && t > 0 && t < 1 && length(va + edge * t - vertices[i]) <= weldEpsilon)
+                    inner.push_back({t, i});
+            });
+            std::sort(inner.begin(), inner.end());
+            split.push_back(a);
+            for (auto & v : inner)
+                split.push_back(v.second);
+        }
+
+        // Polygons welded flat have no area and are dropped
+        addFan(split, false, vertices, result.triangles);
+    }
+
+    // A triangle and its reverse are a face of no thickness the BSP trees left over, drop both
+    std::map<std::array<uint32_t, 3>, size_t> unmatched;
+    std::vector<bool> dropped(result.triangles.size());
+    for (size_t i = 0; i < result.triangles.size(); i++) {
+        std::array<uint32_t, 3> t = result.triangles[i];
+        std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+        auto reverse = unmatched.find({t[0], t[2], t[1]});
+        if (reverse != unmatched.end()) {
+            dropped[i] = dropped[reverse->second] = true;
+            unmatched.erase(reverse);
+        } else {
+            unmatched.insert({t, i});
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < result.triangles.size(); i++) {
+        if (!dropped[i])
+            result.triangles[kept++] = result.triangles[i];
+    }
+    result.triangles.resize(kept);
+
+    // Where the BSP trees classified points near a plane inconsistently, tiny slivers of a face can be missing
+    // (a fraction of a mm, in one plane). Follow the edges around each hole and close it with a fan.
+    std::unordered_map<uint32_t, std::vector<uint32_t>> border;
+    std::unordered_map<uint64_t, int> uses = edgeUses(result.triangles);
+    for (const auto & edge : uses) {
+        uint32_t a = uint32_t(edge.first >> 32), b = uint32_t(edge.first);
+        auto reverse = uses.find(edgeKey(b, a));
+        for (int k = edge.second - (reverse == uses.end() ? 0 : reverse->second); k > 0; k--)
+            border[a].push_back(b);
+    }
+    std::vector<uint32_t> starts;
+    for (const auto & edges : border)
+        starts.push_back(edges.first);
+    std::sort(starts.begin(), starts.end()); // independent of the hash order
+    for (uint32_t start : starts) {
+        std::vector<uint32_t> path = {start};
+        while (!border[path.back()].empty()) {
+            std::vector<uint32_t> & next = border[path.back()];
+            uint32_t v = next.back();
+            next.pop_back();
+            // Back at a vertex of the path: the part from there is a hole. Its faces are the reverse of the border.
+            auto loopStart = std::find(path.begin(), path.end(), v);
+            if (loopStart == path.end()) {
+                path.push_back(v);
+                continue;
+            }
+            std::vector<uint32_t> hole(path.rbegin(), std::vector<uint32_t>::reverse_iterator(loopStart));
+            addFan(hole, true, vertices, result.triangles);
+            path.erase(loopStart + 1, path.end());
+        }
+    }
+    return result;
+}
+
+
+size_t openEdges(const TriangleMesh & mesh)
+{
+    std::unordered_map<uint64_t, int> uses = edgeUses(mesh.triangles);
+    size_t open = 0;
+    for (const auto & edge : uses) {
+        auto reverse = uses.find(edgeKey(uint32_t(edge.first), uint32_t(edge.first >> 32)));
+        if (reverse == uses.end() || reverse->second != edge.second)
+            open++;
+    }
+    return open;
+}
+
+
+
+// PRIMITIVES
+
+// Orients all polygons of a convex primitive to face away from its center.
+static void orientOutwards(std::vector<Polygon> & polygons, const Vec & center)
+{
+    for (Polygon & p : polygons) {
+        if (dot(p.normal, p.vertices[0] - center) < 0)
+            p.flip();
+    }
+}
+
+
+static std::vector<Polygon> cubePolygons(double sx, double sy, double sz)
+{
+    std::vector<Polygon> polygons;
+    Vec c[8];
+    for (int i = 0; i < 8; i++)
+        c[i] = {(i & 1) ? sx : 0, (i & 2) ? sy : 0, (i & 4) ? sz : 0};
+    int faces[6][4] = {{0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5}};
+    for (auto f : faces)
+        polygons.push_back(Polygon({c[f[0]], c[f[1]], c[f[2]], c[f[3]]}));
+    orientOutwards(polygons, {sx / 2, sy / 2, sz / 2});
+    return polygons;
+}
+
+
+static std::vector<Polygon> cylinderPolygons(double r1, double r2, double h, int faces)
+{
+    faces = std::max(faces, 3);
+    std::vector<Vec> bottom, top;
+    for (int i = 0; i < faces; i++) {
+        double a = 2 * M_PI * i / faces;
+        bottom.push_back({r1 * std::cos(a), r1 * std::sin(a), 0});
+        top.push_back({r2 * std::cos(a), r2 * std::sin(a), h});
+    }
+
+    std::vector<Polygon> polygons;
+    if (r1 > 0) polygons.push_back(Polygon(bottom));
+    if (r2 > 0) polygons.push_back(Polygon(top));
+    for (int i = 0; i < faces; i++) {
+        int j = (i + 1) % faces;
+        std::vector<Vec> side;
+        side.push_back(bottom[i]);
+        if (r1 > 0) side.push_back(bottom[j]);
+        side.push_back(top[j]);
+        if (r2 > 0) side.push_back(top[i]);
+        polygons.push_back(Polygon(side));
+    }
+    orientOutwards(polygons, {0, 0, h / 2});
+    return polygons;
+}
+
+
+static std::vector<Polygon> spherePolygons(double r, int faces)
+{
+    faces = std::max(faces, 3);
+    int rings = (faces + 1) / 2;
+    std::vector<std::vector<Vec>> ring(rings);
+    for (int i = 0; i < rings; i++) {
+        double phi = M_PI * (i + 0.5) / rings;
+        double ringRadius = r * std::sin(phi);
+        double z = r * std::cos(phi);
+        for (int j = 0; j < faces; j++) {
+            double a = 2 * M_PI * j / faces;
+            ring[i].push_back({ringRadius * std::cos(a), ringRadius * std::sin(a), z});
+        }
+    }
+
+    std::vector<Polygon> polygons;
+    polygons.push_back(Polygon(ring.front()));
+    polygons.push_back(Polygon(ring.back()));
+    for (int i = 0; i + 1 < rings; i++) {
+        for (int j = 0; j < faces; j++) {
+            int k = (j + 1) % faces;
+            polygons.push_back(Polygon({ring[i][j], ring[i][k], ring[i + 1][k], ring[i + 1][j]}));
+        }
+    }
+    orientOutwards(polygons, {0, 0, 0});
+    return polygons;
+}
+
+
+static std::vector<Polygon> roundedRectPolygons(double sx, double sy, double h, double radius, int faces)
+{
+    std::vector<Vec> bottom, top;
+    for (const Point & p : roundedRectOutline(sx, sy, radius, faces)) {
+        bottom.push_back({p.x, p.y, 0});
+        top.push_back({p.x, p.y, h});
+    }
+
+    std::vector<Polygon> polygons;
+    polygons.push_back(Polygon(bottom));
+    polygons.push_back(Polygon(top));
+    for (size_t i = 0; i < bottom.size(); i++) {
+        size_t j = (i + 1) % bottom.size();
+        polygons.push_back(Polygon({bottom[i], bottom[j], top[j], top[i]}));
+    }
+    orientOutwards(polygons, {sx / 2, sy / 2, h / 2});
+    return polygons;
+}
+
+
+static Mesh primitiveMesh(const Solid & solid, const Matrix & transform)
+{
+    std::vector<Polygon> local;
+    switch (solid.kind()) {
+    case Solid::CubeKind:     local = cubePolygons(solid.param(0), solid.param(1), solid.param(2)); break;
+    case Solid::CylinderKind: local = cylinderPolygons(solid.param(0), solid.param(1), solid.param(2), solid.param(3)); break;
+    case Solid::SphereKind:   local = spherePolygons(solid.param(0), solid.param(1)); break;
+    case Solid::RoundedRectKind:
+        local = roundedRectPolygons(solid.param(0), solid.param(1), solid.param(2), solid.param(3), solid.param(4));
+        break;
+    default: break;
+    }
+
+    // Mirroring transformations turn the polygons inside out
+    bool mirrored = transform.determinant() < 0;
+    Mesh mesh;
+    for (Polygon & p : local) {
+        for (Vec & v : p.vertices)
+            v = transform * v;
+        if (mirrored)
+            std::reverse(p.vertices.begin(), p.vertices.end());
+        Polygon polygon(std::move(p.vertices));
+        if (length(polygon.normal) > 0) // skip degenerate ones, like the sides of a cone with radius 0
+            mesh.polygons.push_back(std::move(polygon));
+    }
+    return mesh;
+}
+
+
+
+// EVALUATION
+
+namespace {
+
+class Evaluator
+{
+public:
+    explicit Evaluator(unsigned threads) : freeThreads(int(threads) - 1) {}
+
+    Mesh evaluate(const Solid & solid, const Matrix & transform) {
+        if (solid.isPrimitive())
+            return primitiveMesh(solid, transform);
+        if (solid.isTransform())
+            return evaluate(solid.children()[0], transform * solid.matrix());
+
+        std::vector<Mesh> meshes = evaluateAll(solid.children(), transform);
+        switch (solid.kind()) {
+        case Solid::UnionKind:
+            return unite(meshes, 0, meshes.size());
+        case Solid::DifferenceKind:
+            if (meshes.empty())
+                return Mesh();
+            return meshDifference(std::move(meshes[0]), unite(meshes, 1, meshes.size()));
+        case Solid::IntersectionKind: {
+            if (meshes.empty())
+                return Mesh();
+            Mesh result = std::move(meshes[0]);
+            for (size_t i = 1; i < meshes.size(); i++)
+                result = meshIntersection(std::move(result), std::move(meshes[i]));
+            return result;
+        }
+        case Solid::HullKind:
+            return meshHull(unite(meshes, 0, meshes.size(), true));
+        default:
+            return Mesh();
+        }
+    }
+
+private:
+    // Children are evaluated on other threads while there are some left
+    std::vector<Mesh> evaluateAll(const Solid::Children & children, const Matrix & transform) {
+        std::vector<Mesh> meshes(children.size());
+        std::vector<std::future<void>> running;
+        for (size_t i = 0; i < children.size(); i++) {
+            if (i + 1 < children.size() && --freeThreads >= 0) {
+                running.push_back(std::async(std::launch::async, [&, i] {
+                    meshes[i] = evaluate(children[i], transform);
+                    ++freeThreads;
+                }));
+            } else {
+                if (i + 1 < children.size())
+                    ++freeThreads;
+                meshes[i] = evaluate(children[i], transform);
+            }
+        }
+        for (auto & f : running)
+            f.get();
+        return meshes;
+    }
+
+    // Balanced union of meshes[begin..end). With justCollect, only the polygons are collected (for hulls).
+    Mesh unite(std::vector<Mesh> & meshes, size_t begin, size_t end, bool justCollect = false) {
+        if (begin == end)
+            return Mesh();
+        if (end - begin == 1)
+            return std::move(meshes[begin]);
+        size_t mid = begin + (end - begin) / 2;
+        Mesh a = unite(meshes, begin, mid, justCollect);
+        Mesh b = unite(meshes, mid, end, justCollect);
+        if (justCollect) {
+            a.polygons.insert(a.polygons.end(), b.polygons.begin(), b.polygons.end());
+            return a;
+        }
+        return meshUnion(std::move(a), std::move(b));
+    }
+
+    std::atomic<int> freeThreads;
+};
+
+} // namespace
+
+
+Mesh evaluateMesh(const Solid & solid, unsigned threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    Evaluator evaluator(threads);
+    return evaluator.evaluate(solid, Matrix::identity());
+}
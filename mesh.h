@@ -0,0 +1,73 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "geom.h"
+#include "solid.h"
+
+
+// Native mesh backend: evaluates a Solid tree to a polygon mesh in process,
+// without OpenSCAD / CGAL.
+//
+// Primitives are tessellated like OpenSCAD does for the same number of
+// faces. Booleans use BSP trees over convex polygons (as in csg.js) with a
+// small plane tolerance; operands with disjoint bounding boxes are combined
+// without any BSP work, which covers most of the features of a case. The
+// result is made watertight for export by triangulate().
+// Independent subtrees are evaluated on separate threads.
+
+
+// Convex planar polygon, vertices counter-clockwise seen from outside.
+struct Polygon {
+    std::vector<Vec> vertices;
+    Vec normal;
+    double w; // plane: dot(normal, p) == w
+
+    Polygon() {}
+    Polygon(std::vector<Vec> vertices);
+    Polygon(std::vector<Vec> vertices, const Vec & normal, double w);
+    void flip();
+};
+
+
+struct Mesh {
+    std::vector<Polygon> polygons;
+
+    Box bounds() const;
+    size_t triangleCount() const;
+};
+
+
+Mesh meshUnion(Mesh a, Mesh b);
+Mesh meshDifference(Mesh a, Mesh b);
+Mesh meshIntersection(Mesh a, Mesh b);
+
+// Convex hull of all vertices of the mesh
+Mesh meshHull(const Mesh & points);
+
+// Triangles with shared vertices, as written to STL / 3MF.
+struct TriangleMesh {
+    std::vector<Vec> vertices;
+    std::vector<std::array<uint32_t, 3>> triangles; // counter-clockwise seen from outside
+};
+
+// Triangulates the polygons for export. The BSP splits leave vertices which
+// differ in the last bits and T-junctions (a vertex of one polygon in the
+// middle of an edge of its neighbour), so first vertices closer than the
+// plane tolerance are welded and the polygon edges are split at the
+// vertices lying on them. After that, each edge of a closed mesh is used
+// once in each direction, as 3MF and slicers require.
+TriangleMesh triangulate(const Mesh & mesh);
+
+// Number of directed edges (a, b) used more or less often than (b, a),
+// 0 if the mesh is closed.
+size_t openEdges(const TriangleMesh & mesh);
+
+// Evaluates the tree. Subtrees are evaluated in parallel up to the given
+// number of threads (0 = one per core, 1 = no threads).
+Mesh evaluateMesh(const Solid & solid, unsigned threads = 0);
+
+
+#endif // MESH_H
@@ -0,0 +1,193 @@
+#include "meshexport.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+
+
+// Little endian output helpers
+static void put16(std::string & out, uint16_t value)
+{
+    out += char(value & 0xff);
+    out += char(value >> 8);
+}
+
+static void put32(std::string & out, uint32_t value)
+{
+    put16(out, value & 0xffff);
+    put16(out, value >> 16);
+}
+
+static void putFloat(std::string & out, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    put32(out, bits);
+}
+
+
+// Writes a temporary file first and moves it in place (see ScadWriter)
+static bool writeFile(const std::string & fileName, const std::string & data)
+{
+    std::string temporary = fileName + ".tmp";
+    std::ofstream out(temporary, std::ios::binary);
+    out.write(data.data(), data.size());
+    out.close();
+    if (!out || std::rename(temporary.c_str(), fileName.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+bool writeStl(const std::string & fileName, const TriangleMesh & mesh)
+{
+    std::string data(80, '\0'); // header
+    std::strncpy(&data[0], "binary STL written by casefactory", 80);
+    put32(data, mesh.triangles.size());
+
+    for (const auto & t : mesh.triangles) {
+        const Vec & a = mesh.vertices[t[0]];
+        const Vec & b = mesh.vertices[t[1]];
+        const Vec & c = mesh.vertices[t[2]];
+        Vec normal = cross(b - a, c - a);
+        double l = length(normal);
+        if (l > 0)
+            normal /= l;
+        putFloat(data, normal.x);
+        putFloat(data, normal.y);
+        putFloat(data, normal.z);
+        for (const Vec & v : {a, b, c}) {
+            putFloat(data, v.x);
+            putFloat(data, v.y);
+            putFloat(data, v.z);
+        }
+        put16(data, 0); // attributes
+    }
+
+    return writeFile(fileName, data);
+}
+
+
+
+// Minimal ZIP writer (stored entries, no compression), which is all 3MF requires.
+class ZipWriter
+{
+public:
+    void add(const std::string & name, const std::string & content) {
+        uint32_t crc = crc32(content);
+        uint32_t offset = data.size();
+
+        put32(data, 0x04034b50); // local file header
+        put16(data, 20);         // version needed
+        put16(data, 0);          // flags
+        put16(data, 0);          // stored
+        put16(data, 0);          // time
+        put16(data, 0x21);       // date: 1980-01-01
+        put32(data, crc);
+        put32(data, content.size());
+        put32(data, content.size());
+        put16(data, name.size());
+        put16(data, 0);          // extra field length
+        data += name;
+        data += content;
+
+        put32(directory, 0x02014b50); // central directory header
+        put16(directory, 20);         // version made by
+        put16(directory, 20);         // version needed
+        put16(directory, 0);
+        put16(directory, 0);
+        put16(directory, 0);
+        put16(directory, 0x21);
+        put32(directory, crc);
+        put32(directory, content.size());
+        put32(directory, content.size());
+        put16(directory, name.size());
+        put16(directory, 0);          // extra field length
+        put16(directory, 0);          // comment length
+        put16(directory, 0);          // disk number
+        put16(directory, 0);          // internal attributes
+        put32(directory, 0);          // external attributes
+        put32(directory, offset);
+        directory += name;
+        entries++;
+    }
+
+    std::string finish() {
+        std::string result = data + directory;
+        put32(result, 0x06054b50); // end of central directory
+        put16(result, 0);
+        put16(result, 0);
+        put16(result, entries);
+        put16(result, entries);
+        put32(result, directory.size());
+        put32(result, data.size());
+        put16(result, 0);          // comment length
+        return result;
+    }
+
+private:
+    static uint32_t crc32(const std::string & bytes) {
+        static uint32_t table[256];
+        static bool initialized = false;
+        if (!initialized) {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                table[i] = c;
+            }
+            initialized = true;
+        }
+        uint32_t crc = 0xffffffff;
+        for (unsigned char b : bytes)
+            crc = table[(crc ^ b) & 0xff] ^ (crc >> 8);
+        return crc ^ 0xffffffff;
+    }
+
+    std::string data;
+    std::string directory;
+    int entries = 0;
+};
+
+
+bool write3mf(const std::string & fileName, const TriangleMesh & mesh)
+{
+    std::ostringstream vertices, triangles;
+    vertices.precision(9);
+    for (const Vec & v : mesh.vertices)
+        vertices << "<vertex x=\"" << v.x << "\" y=\"" << v.y << "\" z=\"" << v.z << "\"/>\n";
+    for (const auto & t : mesh.triangles)
+        triangles << "<triangle v1=\"" << t[0] << "\" v2=\"" << t[1] << "\" v3=\"" << t[2] << "\"/>\n";
+
+    std::string model =
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<model unit=\"millimeter\" xml:lang=\"en-US\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+            "<resources>\n<object id=\"1\" type=\"model\">\n<mesh>\n"
+            "<vertices>\n" + vertices.str() + "</vertices>\n"
+            "<triangles>\n" + triangles.str() + "</triangles>\n"
+            "</mesh>\n</object>\n</resources>\n"
+            "<build>\n<item objectid=\"1\"/>\n</build>\n"
+            "</model>\n";
+
+    ZipWriter zip;
+    zip.add("[Content_Types].xml",
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n"
+            "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n"
+            "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>\n"
+            "</Types>\n");
+    zip.add("_rels/.rels",
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n"
+            "<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>\n"
+            "</Relationships>\n");
+    zip.add("3D/3dmodel.model", model);
+
+    std::string data = zip.finish();
+    return writeFile(fileName, data);
+}
@@ -0,0 +1,17 @@
+#ifndef MESHEXPORT_H
+#define MESHEXPORT_H
+
+#include <string>
+#include "mesh.h"
+
+
+// Writes the mesh (see triangulate) as binary STL. Returns false if the
+// file can't be written.
+bool writeStl(const std::string & fileName, const TriangleMesh & mesh);
+
+// Writes the mesh as 3MF (a ZIP package with the model as XML). Returns
+// false if the file can't be written.
+bool write3mf(const std::string & fileName, const TriangleMesh & mesh);
+
+
+#endif // MESHEXPORT_H
@@ -0,0 +1,93 @@
+#include "optimizer.h"
+
+#include <algorithm>
+
+
+
+ParameterVariations defaultOptimizerVariations()
+{
+    return {
+        {"walls",               {"1.6", "2", "2.4", "3"}},
+        {"floors",              {"1.2", "1.6", "2"}},
+        {"space",               {"0.2", "0.3", "0.5"}},
+        {"holesWalls",          {"1", "1.3", "1.6"}},
+        {"holesFloors",         {"3", "4"}},
+        {"smallerBottomHeight", {"0", "0.5", "1"}},
+        {"smallerTopHeight",    {"0", "0.5", "1"}},
+        {"cornerRadius",        {"0", "1", "2", "3"}},
+    };
+}
+
+
+bool optimizeParameters(CaseFactory & factory, const ParameterVariations & variations,
+                        const OptimizerConstraints & constraints, std::vector<OptimizerResult> & results,
+                        size_t & evaluated, std::string & error)
+{
+    ParameterList original;
+    for (auto variation : variations) {
+        if (variation.second.empty()) {
+            error = "no values for parameter " + variation.first;
+            return false;
+        }
+        original.push_back({variation.first, factory.parameterValue(variation.first)});
+    }
+
+    // Feasible combinations by their objectives. A combination is stored as its number, with the first variation
+    // counting fastest.
+    struct Candidate {
+        double material;
+        double outerVolume;
+        size_t number;
+    };
+    std::vector<Candidate> candidates;
+
+    // Cross product of all variations, counting like an odometer
+    std::vector<size_t> counter(variations.size(), 0);
+    evaluated = 0;
+    bool ok = true;
+    for (bool done = false; !done && ok; evaluated++) {
+        for (size_t i = 0; i < variations.size() && ok; i++) {
+            const std::string & value = variations[i].second[counter[i]];
+            if (!factory.setParameter(variations[i].first, value)) {
+                error = "invalid parameter " + variations[i].first + "=" + value;
+                ok = false;
+            }
+        }
+
+        CaseMeasures measures = factory.measure();
+        if (measures.thinnestWall >= constraints.minWall && measures.thinnestFloor >= constraints.minFloor)
+            candidates.push_back({measures.material, measures.outer.x * measures.outer.y * measures.outer.z, evaluated});
+
+        size_t i = 0;
+        while (i < counter.size() && ++counter[i] == variations[i].second.size())
+            counter[i++] = 0;
+        done = (i == counter.size());
+    }
+
+    // Sorted by material, a combination is Pareto-optimal if its outer volume is below all before it
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate & a, const Candidate & b) {
+        return a.material < b.material || (a.material == b.material && a.outerVolume < b.outerVolume);
+    });
+    results.clear();
+    double smallestOuter = 0;
+    for (const Candidate & candidate : candidates) {
+        if (!results.empty() && candidate.outerVolume >= smallestOuter)
+            continue;
+        smallestOuter = candidate.outerVolume;
+
+        OptimizerResult result;
+        size_t number = candidate.number;
+        for (auto variation : variations) {
+            const std::string & value = variation.second[number % variation.second.size()];
+            number /= variation.second.size();
+            factory.setParameter(variation.first, value);
+            result.parameters.push_back({variation.first, value});
+        }
+        result.measures = factory.measure();
+        results.push_back(result);
+    }
+
+    for (auto parameter : original)
+        factory.setParameter(parameter.first, parameter.second);
+    return ok;
+}
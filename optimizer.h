@@ -0,0 +1,45 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "casefactory.h"
+#include "casejob.h"
+
+
+// Candidate values per parameter, like the "vary" statements of a batch
+// manifest (see casejob.h)
+typedef std::vector<std::pair<std::string, std::vector<std::string>>> ParameterVariations;
+
+// What a case has to fulfill to be considered (see CaseMeasures)
+struct OptimizerConstraints {
+    double minWall = 1.2;  // mm, thinnest wall at the corners and around the port holes
+    double minFloor = 0.8; // mm, thinnest floor beneath the forbidden areas
+};
+
+// One Pareto-optimal parameter set
+struct OptimizerResult {
+    ParameterList parameters; // values of the varied parameters
+    CaseMeasures measures;
+};
+
+
+// The parameters worth tuning for most boards (walls, floors, space,
+// screw hole enclosures, smaller heights and corner radius), each with a
+// few sensible values.
+ParameterVariations defaultOptimizerVariations();
+
+// Measures every combination of the variations on the factory (see
+// CaseFactory::measure(), no geometry is constructed) and returns the
+// combinations which fulfill the constraints and are Pareto-optimal for
+// material volume and outer volume, by increasing material. Sets
+// evaluated to the number of combinations measured. The parameters of the
+// factory are left unchanged. On an invalid parameter value, returns
+// false and sets error.
+bool optimizeParameters(CaseFactory & factory, const ParameterVariations & variations,
+                        const OptimizerConstraints & constraints, std::vector<OptimizerResult> & results,
+                        size_t & evaluated, std::string & error);
+
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,70 @@
+#include "partcache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+PartCache::PartCache(const std::string & directory) :
+    directory(directory)
+{
+    mkdir(directory.c_str(), 0777);
+}
+
+
+bool PartCache::fetch(const Files & files)
+{
+    struct stat entryStat;
+    for (auto file : files) {
+        if (stat(entry(file.first).c_str(), &entryStat) != 0) {
+            missCount++;
+            return false;
+        }
+    }
+
+    for (auto file : files) {
+        // Nothing to do if the output is the cached file already
+        struct stat outputStat;
+        stat(entry(file.first).c_str(), &entryStat);
+        if (stat(file.second.c_str(), &outputStat) == 0 &&
+                outputStat.st_dev == entryStat.st_dev && outputStat.st_ino == entryStat.st_ino)
+            continue;
+
+        // Link next to the output, then replace the output at once
+        std::string temporary = file.second + ".tmp";
+        std::remove(temporary.c_str());
+        if (link(entry(file.first).c_str(), temporary.c_str()) != 0 ||
+                std::rename(temporary.c_str(), file.second.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            missCount++;
+            return false;
+        }
+    }
+    hitCount++;
+    return true;
+}
+
+
+void PartCache::store(const Files & files)
+{
+    for (auto file : files) {
+        // Linking fails if another job stored the same entry meanwhile, which is fine
+        link(file.second.c_str(), entry(file.first).c_str());
+    }
+}
+
+
+
+std::string hashText(const std::string & text)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) hash);
+    return hex;
+}
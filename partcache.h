@@ -0,0 +1,49 @@
+#ifndef PARTCACHE_H
+#define PARTCACHE_H
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Persistent cache of generated files, keyed by a hash of everything they
+// depend on (see runCaseJob). Entries live in one directory and are hard
+// linked to the output files, so a hit costs no copy, and an output which
+// still is the linked entry isn't touched at all. Writers replace output
+// files instead of overwriting them (see ScadWriter), so entries stay
+// intact. The directory has to be on the same file system as the outputs
+// (otherwise every lookup misses). Safe to use from several threads.
+class PartCache
+{
+public:
+    // Pairs of (key, output file name) which are generated together
+    typedef std::vector<std::pair<std::string, std::string>> Files;
+
+    explicit PartCache(const std::string & directory);
+
+    //! Makes all files the cached ones for their keys and counts a hit.
+    //! If any of them isn't cached, nothing is changed and a miss is
+    //! counted.
+    bool fetch(const Files & files);
+
+    //! Stores the files just generated for their keys.
+    void store(const Files & files);
+
+    int hits() const { return hitCount; }
+    int misses() const { return missCount; }
+
+private:
+    std::string entry(const std::string & key) const { return directory + "/" + key; }
+
+    std::string directory;
+    std::atomic<int> hitCount{0};
+    std::atomic<int> missCount{0};
+};
+
+
+// 64 bit FNV-1a hash of the text, as 16 hex digits
+std::string hashText(const std::string & text);
+
+
+#endif // PARTCACHE_H
@@ -0,0 +1,140 @@
+#include "platepacker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <sstream>
+
+
+
+namespace {
+
+struct Rect {
+    double x, y, width, depth;
+
+    bool contains(const Rect & r) const {
+        return r.x >= x && r.y >= y && r.x + r.width <= x + width && r.y + r.depth <= y + depth;
+    }
+    bool overlaps(const Rect & r) const {
+        return r.x < x + width && x < r.x + r.width && r.y < y + depth && y < r.y + r.depth;
+    }
+};
+
+// One bed: the maximal free rectangles (which may overlap each other) of MaxRects
+struct Plate {
+    std::vector<Rect> free;
+    double freeArea;
+};
+
+
+// Best short side fit: the free rectangle leaving the least space along its shorter leftover side.
+// Returns false if the part fits in none.
+bool findPosition(const Plate & plate, double width, double depth, Rect & position, bool & rotated)
+{
+    double bestShort = HUGE_VAL;
+    double bestLong = HUGE_VAL;
+    for (const Rect & r : plate.free) {
+        for (int turn = 0; turn < 2; turn++) {
+            double w = turn ? depth : width;
+            double d = turn ? width : depth;
+            if (w > r.width || d > r.depth)
+                continue;
+            double shortSide = std::min(r.width - w, r.depth - d);
+            double longSide = std::max(r.width - w, r.depth - d);
+            if (shortSide < bestShort || (shortSide == bestShort && longSide < bestLong)) {
+                bestShort = shortSide;
+                bestLong = longSide;
+                position = {r.x, r.y, w, d};
+                rotated = turn;
+            }
+        }
+    }
+    return bestShort != HUGE_VAL;
+}
+
+
+// Cuts the used rectangle out of all free ones, keeping the maximal rest rectangles
+void place(Plate & plate, const Rect & used)
+{
+    std::vector<Rect> free;
+    for (const Rect & r : plate.free) {
+        if (!r.overlaps(used)) {
+            free.push_back(r);
+            continue;
+        }
+        if (used.x > r.x)
+            free.push_back({r.x, r.y, used.x - r.x, r.depth});
+        if (used.x + used.width < r.x + r.width)
+            free.push_back({used.x + used.width, r.y, r.x + r.width - used.x - used.width, r.depth});
+        if (used.y > r.y)
+            free.push_back({r.x, r.y, r.width, used.y - r.y});
+        if (used.y + used.depth < r.y + r.depth)
+            free.push_back({r.x, used.y + used.depth, r.width, r.y + r.depth - used.y - used.depth});
+    }
+
+    // Drop the rectangles contained in others (of two equal ones, the first is kept)
+    std::vector<bool> redundant(free.size(), false);
+    for (size_t i = 0; i < free.size(); i++) {
+        for (size_t j = 0; j < free.size() && !redundant[i]; j++) {
+            if (i != j && !redundant[j] && free[j].contains(free[i]))
+                redundant[i] = true;
+        }
+    }
+    plate.free.clear();
+    for (size_t i = 0; i < free.size(); i++) {
+        if (!redundant[i])
+            plate.free.push_back(free[i]);
+    }
+    plate.freeArea -= used.width * used.depth;
+}
+
+} // namespace
+
+
+
+int packPlates(const std::vector<PlateItem> & items, double bedWidth, double bedDepth, double gap,
+               std::vector<PlatePlacement> & placements, std::string & error)
+{
+    // Each part takes its footprint plus the gap on the far sides. The bed is enlarged by the gap, so parts at
+    // its far edges still fit.
+    Plate empty = {{{0, 0, bedWidth + gap, bedDepth + gap}}, (bedWidth + gap) * (bedDepth + gap)};
+
+    // Largest first, by the longer side and then the area, so the small parts fill the gaps left by them
+    std::vector<size_t> order(items.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        double longA = std::max(items[a].width, items[a].depth);
+        double longB = std::max(items[b].width, items[b].depth);
+        if (longA != longB)
+            return longA > longB;
+        return items[a].width * items[a].depth > items[b].width * items[b].depth;
+    });
+
+    std::vector<Plate> plates;
+    placements.assign(items.size(), PlatePlacement());
+    for (size_t index : order) {
+        double width = items[index].width + gap;
+        double depth = items[index].depth + gap;
+        Rect position;
+        bool rotated = false;
+        size_t plate = 0;
+        while (plate < plates.size() &&
+               (plates[plate].freeArea < width * depth || !findPosition(plates[plate], width, depth, position, rotated)))
+            plate++;
+        if (plate == plates.size()) {
+            plates.push_back(empty);
+            if (!findPosition(plates.back(), width, depth, position, rotated)) {
+                std::ostringstream message;
+                message << "a part of " << items[index].width << " x " << items[index].depth << " mm doesn't fit on the bed";
+                error = message.str();
+                return 0;
+            }
+        }
+        place(plates[plate], position);
+        placements[index].plate = plate;
+        placements[index].x = position.x;
+        placements[index].y = position.y;
+        placements[index].rotated = rotated;
+    }
+    return plates.size();
+}
@@ -0,0 +1,33 @@
+#ifndef PLATEPACKER_H
+#define PLATEPACKER_H
+
+#include <string>
+#include <vector>
+
+
+// Footprint of one part to print, mm
+struct PlateItem {
+    double width;
+    double depth;
+};
+
+// Where a part goes: its footprint's corner at (x, y) on the given plate,
+// turned by 90 degrees (width along y) if rotated
+struct PlatePlacement {
+    int plate = -1;
+    double x = 0;
+    double y = 0;
+    bool rotated = false;
+};
+
+
+// Packs the footprints onto as few print beds as it can (MaxRects with the
+// best short side fit, largest parts first, each one on the first bed where
+// it fits). Parts keep at least gap to each other; they may touch the edges
+// of the bed. Fills placements (in the order of the items) and returns the
+// number of beds. Returns 0 and sets error if a part fits on no bed.
+int packPlates(const std::vector<PlateItem> & items, double bedWidth, double bedDepth, double gap,
+               std::vector<PlatePlacement> & placements, std::string & error);
+
+
+#endif // PLATEPACKER_H
@@ -0,0 +1,230 @@
+#include "renderer.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "partcache.h"
+#include "trace.h"
+#include "workpool.h"
+
+
+
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+
+// One file to render
+struct Render {
+    std::string scadFile;
+    std::string stlFile;
+    std::string hash;    // of the bytes of the SCAD file
+    int same = -1;       // index of an earlier file with the same bytes, whose STL this one gets
+    bool ok = false;
+    bool cached = false;
+    double seconds = 0;
+    std::string message; // why it failed
+};
+
+} // namespace
+
+
+static bool readFile(const std::string & fileName, std::string & text)
+{
+    std::ifstream in(fileName, std::ios::binary);
+    if (!in)
+        return false;
+    std::ostringstream bytes;
+    bytes << in.rdbuf();
+    text = bytes.str();
+    return true;
+}
+
+
+static std::string stlFileName(const std::string & scadFile)
+{
+    size_t dot = scadFile.size() - 5;
+    if (scadFile.size() > 5 && scadFile.compare(dot, 5, ".scad") == 0)
+        return scadFile.substr(0, dot) + ".stl";
+    return scadFile + ".stl";
+}
+
+
+// Runs the program (looked up on the path) with the arguments, without a shell, so file names are passed as
+// they are. Its output and errors go to the file. Returns the status as waitpid gives it, with exit code 127 if
+// the program or the output file can't be opened.
+static int runProgram(const std::vector<std::string> & arguments, const std::string & outputFile)
+{
+    std::vector<char *> argv;
+    for (const std::string & argument : arguments)
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, outputFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (spawned != 0)
+        return 127 << 8;
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return 127 << 8;
+    }
+    return status;
+}
+
+
+// Runs OpenSCAD on the file. It writes to a temporary file first (with the extension it takes the format from),
+// which replaces the STL when it is complete. Its output goes to <stl file>.log, which is kept if it fails.
+static bool runOpenscad(const std::string & openscad, const std::string & scadFile, const std::string & stlFile,
+                        std::string & message)
+{
+    std::string temporary = stlFile.substr(0, stlFile.size() - 4) + ".tmp.stl";
+    std::string output = stlFile + ".log";
+    int status = runProgram({openscad, "-o", temporary, scadFile}, output);
+    if (status == 0 && std::rename(temporary.c_str(), stlFile.c_str()) == 0) {
+        std::remove(output.c_str());
+        return true;
+    }
+    std::remove(temporary.c_str());
+    std::remove(stlFile.c_str()); // it belongs to an older SCAD file
+
+    // The last line OpenSCAD printed usually says what went wrong
+    std::ifstream log(output);
+    std::string last;
+    for (std::string line; std::getline(log, line); ) {
+        if (!line.empty())
+            last = line;
+    }
+    if (status == 0)
+        message = "cannot write " + stlFile;
+    else if (WIFEXITED(status) && WEXITSTATUS(status) == 127)
+        message = "cannot run " + openscad;
+    else
+        message = (last.empty() ? "failed" : last) + " (see " + output + ")";
+    return false;
+}
+
+
+// Gives the file the same content: a hard link which replaces it at once, or a copy if linking fails
+static bool linkFile(const std::string & from, const std::string & to)
+{
+    if (from == to)
+        return true;
+    std::string temporary = to + ".tmp";
+    std::remove(temporary.c_str());
+    if (link(from.c_str(), temporary.c_str()) != 0) {
+        std::ifstream in(from, std::ios::binary);
+        std::ofstream out(temporary, std::ios::binary);
+        out << in.rdbuf();
+        out.close();
+        if (!in || !out) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporary.c_str(), to.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+
+bool renderScadFiles(const std::vector<std::string> & scadFiles, const RenderOptions & options, std::ostream & log,
+                     std::string & error)
+{
+    TraceScope trace("renderScadFiles");
+    Clock::time_point start = Clock::now();
+
+    // Only the first file with the same bytes is rendered
+    std::vector<Render> renders(scadFiles.size());
+    std::unordered_map<std::string, int> firstWithHash;
+    for (size_t i = 0; i < scadFiles.size(); i++) {
+        Render & render = renders[i];
+        render.scadFile = scadFiles[i];
+        render.stlFile = stlFileName(scadFiles[i]);
+        std::string bytes;
+        if (!readFile(render.scadFile, bytes)) {
+            render.message = "cannot read the file";
+            continue;
+        }
+        render.hash = hashText(bytes);
+        auto first = firstWithHash.insert({render.hash, int(i)});
+        if (!first.second)
+            render.same = first.first->second;
+    }
+
+    WorkPool pool(options.jobs);
+    for (size_t i = 0; i < renders.size(); i++) {
+        if (renders[i].same >= 0 || !renders[i].message.empty())
+            continue;
+        pool.submit([&, i] {
+            Render & render = renders[i];
+            TraceScope renderTrace("render", render.scadFile);
+            Clock::time_point renderStart = Clock::now();
+            PartCache::Files stl = {{render.hash + ".stl", render.stlFile}};
+            if (options.cache && options.cache->fetch(stl)) {
+                render.ok = true;
+                render.cached = true;
+            } else {
+                render.ok = runOpenscad(options.openscad, render.scadFile, render.stlFile, render.message);
+                if (render.ok && options.cache)
+                    options.cache->store(stl);
+            }
+            render.seconds = std::chrono::duration<double>(Clock::now() - renderStart).count();
+        });
+    }
+    pool.wait();
+
+    // Report in the order of the files, and give the files rendered by others their STL
+    int rendered = 0, cached = 0, same = 0;
+    bool failed = false;
+    std::streamsize precision = log.precision();
+    log << std::fixed << std::setprecision(2);
+    for (Render & render : renders) {
+        log << "Rendering " << render.scadFile << " ... ";
+        if (render.same >= 0) {
+            const Render & original = renders[render.same];
+            render.ok = original.ok && linkFile(original.stlFile, render.stlFile);
+            if (!render.ok)
+                render.message = original.ok ? "cannot write " + render.stlFile : original.message;
+        }
+
+        if (!render.ok) {
+            log << "FAILED: " << render.message << std::endl;
+            if (!failed)
+                error = "cannot render " + render.scadFile + ": " + render.message;
+            failed = true;
+        } else if (render.same >= 0) {
+            same++;
+            log << "same as " << renders[render.same].scadFile << std::endl;
+        } else if (render.cached) {
+            cached++;
+            log << "cached" << std::endl;
+        } else {
+            rendered++;
+            log << "done (" << render.seconds << " s)" << std::endl;
+        }
+    }
+    log << "Rendered " << renders.size() << " files in " << std::chrono::duration<double>(Clock::now() - start).count()
+        << " s (" << rendered << " by OpenSCAD, " << cached << " cached, " << same << " with the same bytes as another)"
+        << " with up to " << pool.threadCount() << " at once" << std::endl;
+    log.unsetf(std::ios::floatfield);
+    log.precision(precision);
+    return !failed;
+}
@@ -0,0 +1,32 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+class PartCache;
+
+
+// How to render SCAD files, see renderScadFiles
+struct RenderOptions {
+    std::string openscad = "openscad"; // program to run, on the path or with its directory
+    unsigned jobs = 0;                 // renders at once, 0 = one per core
+    PartCache * cache = nullptr;       // STLs of earlier runs, null = none
+};
+
+// Renders each <name>.scad to <name>.stl with OpenSCAD, several at once.
+//
+// The STL only depends on the bytes of the SCAD file, so each file is
+// rendered under the hash of its bytes (see hashText): files with the same
+// bytes are rendered once and get the same STL, and with a cache, bytes
+// rendered in an earlier run are taken from there. The STLs replace the
+// old ones at once, like the SCAD files. Prints one line per file with its
+// render time, in the order of the files (so the log doesn't depend on
+// which render finishes first). Returns false and sets error if any file
+// fails; the others are rendered anyway.
+bool renderScadFiles(const std::vector<std::string> & scadFiles, const RenderOptions & options, std::ostream & log,
+                     std::string & error);
+
+
+#endif // RENDERER_H
@@ -0,0 +1,298 @@
+#include "scadwriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+
+// Shortest form which still gives the same double for all values we generate
+static std::string number(double value)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.15g", value);
+    return (std::strcmp(text, "-0") == 0) ? "0" : text;
+}
+
+static std::string vector(const Solid & solid)
+{
+    return "[" + number(solid.param(0)) + ", " + number(solid.param(1)) + ", " + number(solid.param(2)) + "]";
+}
+
+// Outline of a RoundedRectKind solid with rounded corners as 2D statement (with the ";"), corner at the origin
+static std::string roundedRectProfile(const Solid & solid)
+{
+    double sx = solid.param(0), sy = solid.param(1), r = solid.param(3);
+
+    // offset() of a square without area would be empty, but the hull of the corner circles is the same outline
+    if (sx - 2 * r < 1e-6 || sy - 2 * r < 1e-6) {
+        std::string circle = "circle(r=" + number(r) + ", $fn=" + number(solid.param(4)) + ");";
+        return "hull() { translate([" + number(r) + ", " + number(r) + "]) " + circle + " translate([" +
+               number(sx - r) + ", " + number(sy - r) + "]) " + circle + " }";
+    }
+    return "offset(r=" + number(r) + ", $fn=" + number(solid.param(4)) + ") translate([" + number(r) + ", " +
+           number(r) + "]) square([" + number(sx - 2 * r) + ", " + number(sy - 2 * r) + "]);";
+}
+
+
+
+ScadWriter::ScadWriter(const std::string & fileName) :
+    fileName(fileName),
+    fd(::open((fileName + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)),
+    failed(fd < 0)
+{
+}
+
+
+ScadWriter::~ScadWriter()
+{
+    close();
+}
+
+
+void ScadWriter::declareModules(const std::vector<Solid> & models)
+{
+    // Count the occurrences of each structure. Subtrees of a repeated subtree are only counted at its first
+    // occurrence, so they only become modules if they are also used somewhere else.
+    std::unordered_map<int, int> count;
+    std::vector<std::pair<Solid, int>> visited;
+    std::vector<int> repeated;
+    std::vector<Solid> stack(models.rbegin(), models.rend());
+    while (!stack.empty()) {
+        Solid solid = stack.back();
+        stack.pop_back();
+        int id = structure(solid);
+        visited.push_back({solid, id});
+        int n = ++count[id];
+        if (n == 2)
+            repeated.push_back(id);
+        if (n == 1)
+            stack.insert(stack.end(), solid.children().rbegin(), solid.children().rend());
+    }
+
+    // The module body is written from the first occurrence, the only one whose children were visited
+    std::unordered_map<int, Solid> first;
+    for (auto & entry : visited) {
+        if (count[entry.second] > 1)
+            first.insert({entry.second, entry.first});
+    }
+
+    // A single cube is as short as a module instantiation, so it isn't worth one.
+    std::unordered_map<int, std::string> modules; // structure id -> module name
+    int index = 0;
+    for (int id : repeated) {
+        const Solid & solid = first[id];
+        if (solid.kind() == Solid::CubeKind)
+            continue;
+        static const char * names[] = {"cube", "cylinder", "sphere", "rounded_rect", "translate", "rotate", "scale",
+                                       "multmatrix", "union", "difference", "intersection", "hull"};
+        modules[id] = std::string(names[solid.kind()]) + "_" + std::to_string(++index);
+    }
+
+    // Writing reaches only visited nodes: the others are below a module instantiation. So the interned
+    // structures can go, and only the nodes which become instantiations are kept.
+    for (auto & entry : visited) {
+        auto module = modules.find(entry.second);
+        if (module != modules.end())
+            moduleOfNode[entry.first.identity()] = module->second;
+    }
+    std::map<std::vector<double>, int>().swap(structures);
+    std::unordered_map<const void *, int>().swap(structureOfNode);
+
+    // Module definitions are hoisted by OpenSCAD, so their order doesn't matter.
+    for (int id : repeated) {
+        auto module = modules.find(id);
+        if (module == modules.end())
+            continue;
+        line("module " + module->second + "()", true);
+        node(first[id], 0, false);
+        indent--;
+        line("}", false);
+    }
+}
+
+
+void ScadWriter::write(const Solid & solid)
+{
+    node(solid, openBooleans);
+}
+
+
+void ScadWriter::begin(const std::string & statement)
+{
+    line(statement, true);
+    openBooleans++;
+}
+
+
+void ScadWriter::end()
+{
+    openBooleans--;
+    indent--;
+    line("}", false);
+}
+
+
+bool ScadWriter::close()
+{
+    if (fd >= 0) {
+        flush();
+        if (::close(fd) != 0)
+            failed = true;
+        fd = -1;
+        std::string temporary = fileName + ".tmp";
+        if (failed || std::rename(temporary.c_str(), fileName.c_str()) != 0) {
+            failed = true;
+            std::remove(temporary.c_str());
+        }
+    }
+    return !failed;
+}
+
+
+// Interns the structure of the subtree: kind, parameters and the structures of the children.
+int ScadWriter::structure(const Solid & solid)
+{
+    auto known = structureOfNode.find(solid.identity());
+    if (known != structureOfNode.end())
+        return known->second;
+
+    std::vector<double> key = {double(solid.kind()), solid.param(0), solid.param(1), solid.param(2), solid.param(3),
+                               solid.param(4)};
+    if (solid.kind() == Solid::MatrixKind) {
+        for (auto & row : solid.matrix().m)
+            key.insert(key.end(), row, row + 4);
+    }
+    for (const Solid & child : solid.children())
+        key.push_back(structure(child));
+    int id = structures.insert({key, int(structures.size())}).first->second;
+    structureOfNode[solid.identity()] = id;
+    return id;
+}
+
+
+void ScadWriter::node(const Solid & solid, int booleanDepth, bool allowModule)
+{
+    treeStats.nodes++;
+
+    if (allowModule && !moduleOfNode.empty()) {
+        auto module = moduleOfNode.find(solid.identity());
+        if (module != moduleOfNode.end()) {
+            line(module->second + "();", false);
+            return;
+        }
+    }
+
+    const char * op = nullptr;
+    switch (solid.kind()) {
+    case Solid::CubeKind:
+        line("cube(" + vector(solid) + ");", false);
+        return;
+    case Solid::CylinderKind:
+        if (solid.param(0) == solid.param(1)) {
+            line("cylinder(r=" + number(solid.param(0)) + ", h=" + number(solid.param(2)) +
+                 ", $fn=" + number(solid.param(3)) + ");", false);
+            return;
+        }
+        line("cylinder(r1=" + number(solid.param(0)) + ", r2=" + number(solid.param(1)) +
+             ", h=" + number(solid.param(2)) + ", $fn=" + number(solid.param(3)) + ");", false);
+        return;
+    case Solid::SphereKind:
+        line("sphere(r=" + number(solid.param(0)) + ", $fn=" + number(solid.param(1)) + ");", false);
+        return;
+    case Solid::RoundedRectKind: {
+        if (solid.param(3) <= 0) {
+            line("cube(" + vector(solid) + ");", false);
+            return;
+        }
+        line("linear_extrude(height=" + number(solid.param(2)) + ") " + roundedRectProfile(solid), false);
+        return;
+    }
+
+    case Solid::TranslateKind:
+        line("translate(" + vector(solid) + ")", true);
+        break;
+    case Solid::ScaleKind:
+        line("scale(" + vector(solid) + ")", true);
+        break;
+    case Solid::RotateEulerZXZKind:
+        // Rotation around z by phi, then x by theta, then z by psi. Nested, so the innermost is applied first.
+        line("rotate([0, 0, " + number(solid.param(2)) + "]) rotate([" + number(solid.param(1)) +
+             ", 0, 0]) rotate([0, 0, " + number(solid.param(0)) + "])", true);
+        break;
+    case Solid::MatrixKind: {
+        std::string rows;
+        for (auto & row : solid.matrix().m) {
+            rows += "[" + number(row[0]) + ", " + number(row[1]) + ", " + number(row[2]) + ", " +
+                    number(row[3]) + "], ";
+        }
+        line("multmatrix([" + rows + "[0, 0, 0, 1]])", true);
+        break;
+    }
+
+    case Solid::UnionKind:        op = "union()";        break;
+    case Solid::DifferenceKind:   op = "difference()";   break;
+    case Solid::IntersectionKind: op = "intersection()"; break;
+    case Solid::HullKind:         op = "hull()";         break;
+    }
+
+    if (op) {
+        treeStats.booleans++;
+        booleanDepth++;
+        treeStats.depth = std::max(treeStats.depth, booleanDepth);
+        line(op, true);
+    }
+    for (const Solid & child : solid.children())
+        node(child, booleanDepth);
+    indent--;
+    line("}", false);
+}
+
+
+// Writes one line at the current indentation. A line opening a block also increases the indentation.
+void ScadWriter::line(const std::string & text, bool opensBlock)
+{
+    static const std::string spaces(64, ' ');
+    put(spaces.data(), std::min<size_t>(2 * indent, spaces.size()));
+    put(text);
+    put(opensBlock ? " {\n" : "\n");
+    if (opensBlock)
+        indent++;
+}
+
+
+void ScadWriter::put(const char * data, size_t size)
+{
+    treeStats.bytes += size;
+    while (size > 0) {
+        if (used == sizeof(buffer))
+            flush();
+        size_t n = std::min(size, sizeof(buffer) - used);
+        std::memcpy(buffer + used, data, n);
+        used += n;
+        data += n;
+        size -= n;
+    }
+}
+
+
+void ScadWriter::flush()
+{
+    const char * data = buffer;
+    while (used > 0 && !failed) {
+        // write() may take only part of the data, or be interrupted by a signal before writing anything
+        ssize_t n = ::write(fd, data, used);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            failed = true;
+            break;
+        }
+        data += n;
+        used -= n;
+    }
+    used = 0;
+}
@@ -0,0 +1,76 @@
+#ifndef SCADWRITER_H
+#define SCADWRITER_H
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "csgbuilder.h"
+#include "solid.h"
+
+
+// Writes Solid trees in SCAD format straight to a file while walking them.
+//
+// Output goes through a fixed size buffer to the file descriptor, so the
+// text is never held in memory as a whole, unlike serializing a whole OOML
+// Component into an IndentWriter first. The writer also measures the tree
+// it writes.
+//
+// The data goes to a temporary file first, which replaces the file on
+// close(). Readers never see a half written file, and a file hard linked
+// elsewhere (see PartCache) is replaced instead of overwritten.
+class ScadWriter
+{
+public:
+    explicit ScadWriter(const std::string & fileName);
+    ~ScadWriter();
+
+    //! Finds subtrees which occur more than once in the given models (like
+    //! the cylinders of all screw holes) and writes each of them once as
+    //! SCAD module. write() then instantiates the modules instead of
+    //! repeating the subtrees. Call this before writing anything else.
+    //! Finding the subtrees takes memory in the size of the models, which is
+    //! given back before returning; only the nodes which are written as
+    //! module instantiations are remembered.
+    void declareModules(const std::vector<Solid> & models);
+
+    //! Writes a model as top level statement (or inside the current block).
+    void write(const Solid & solid);
+
+    //! Opens a block like "union()" or "translate([0, 10, 0])" for the
+    //! statements written next, until end().
+    void begin(const std::string & statement);
+    void end();
+
+    //! Flushes and closes the file and moves it in place. Returns false if
+    //! anything failed (then the old file is left unchanged).
+    bool close();
+
+    //! Size of everything written so far
+    const CsgStats & stats() const { return treeStats; }
+
+private:
+    void node(const Solid & solid, int booleanDepth, bool allowModule = true);
+    int structure(const Solid & solid);
+    void line(const std::string & text, bool opensBlock);
+    void put(const char * data, size_t size);
+    void put(const std::string & text) { put(text.data(), text.size()); }
+    void flush();
+
+    std::string fileName;
+    int fd;
+    bool failed;
+    int indent = 0;
+    int openBooleans = 0;
+    size_t used = 0;
+    CsgStats treeStats;
+
+    // Structurally identical subtrees get the same structure id (only while declaring modules)
+    std::map<std::vector<double>, int> structures;
+    std::unordered_map<const void *, int> structureOfNode;
+    std::unordered_map<const void *, std::string> moduleOfNode; // node -> name of the module it instantiates
+    char buffer[64 * 1024];
+};
+
+
+#endif // SCADWRITER_H
@@ -0,0 +1,454 @@
+#include "solid.h"
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <ooml/core/Union.h>
+#include <ooml/core/Difference.h>
+#include <ooml/core/Intersection.h>
+#include <ooml/core/Hull.h>
+
+
+
+// Per thread, so counting needs no synchronization
+static thread_local size_t createdCount = 0;
+
+// Innermost SolidArena of the thread
+static thread_local SolidArena * currentArena = nullptr;
+
+
+// Memory of an arena: blocks used from the front, never given back one by one
+struct Solid::Storage {
+    static const size_t blockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char * next = nullptr;
+    size_t left = 0;
+
+    void * allocate(size_t size) {
+        size = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+        if (size > blockSize / 4) {
+            // Big ones get their own block, so the current block isn't wasted
+            blocks.emplace_back(new char[size]);
+            return blocks.back().get();
+        }
+        if (size > left) {
+            blocks.emplace_back(new char[blockSize]);
+            next = blocks.back().get();
+            left = blockSize;
+        }
+        void * p = next;
+        next += size;
+        left -= size;
+        return p;
+    }
+};
+
+
+// Primitives created in an arena scope, by kind and parameters
+struct PrimitiveKey {
+    Solid::Kind kind;
+    double params[5];
+
+    bool operator==(const PrimitiveKey & other) const {
+        return kind == other.kind && std::memcmp(params, other.params, sizeof(params)) == 0;
+    }
+};
+
+struct PrimitiveKeyHash {
+    size_t operator()(const PrimitiveKey & key) const {
+        size_t hash = key.kind;
+        for (double param : key.params)
+            hash = hash * 1000003 ^ std::hash<double>()(param);
+        return hash;
+    }
+};
+
+struct SolidArena::Primitives : std::unordered_map<PrimitiveKey, Solid, PrimitiveKeyHash> {
+};
+
+
+
+SolidArena::SolidArena() :
+    storage(std::make_shared<Solid::Storage>()),
+    primitives(new Primitives),
+    outer(currentArena)
+{
+    currentArena = this;
+}
+
+
+SolidArena::~SolidArena()
+{
+    currentArena = outer;
+}
+
+
+
+std::shared_ptr<Solid::Storage> Solid::currentStorage()
+{
+    return currentArena ? currentArena->storage : nullptr;
+}
+
+
+void * Solid::allocateMemory(Storage * storage, size_t size)
+{
+    return storage ? storage->allocate(size) : ::operator new(size);
+}
+
+
+Solid::Solid() :
+    Solid(UnionKind, 0, 0, 0, 0)
+{
+}
+
+
+Solid::Solid(Kind kind, double p0, double p1, double p2, double p3, Children children, double p4)
+{
+    create(Node{kind, {p0, p1, p2, p3, p4}, std::move(children), Box(), Matrix::identity()});
+}
+
+
+void Solid::create(Node && created)
+{
+    if (!currentArena) {
+        auto n = std::make_shared<Node>(std::move(created));
+        node = n;
+        if (n->kind != MatrixKind)
+            n->transform = computeMatrix();
+        n->bounds = computeBounds();
+        createdCount++;
+        return;
+    }
+
+    // Equal primitives share their node
+    PrimitiveKey key = {created.kind, {}};
+    std::memcpy(key.params, created.params, sizeof(key.params));
+    bool primitive = created.kind <= RoundedRectKind;
+    if (primitive) {
+        auto interned = currentArena->primitives->find(key);
+        if (interned != currentArena->primitives->end()) {
+            node = interned->second.node;
+            return;
+        }
+    }
+
+    auto n = std::allocate_shared<Node>(Allocator<Node>(), std::move(created));
+    node = n;
+    if (n->kind != MatrixKind)
+        n->transform = computeMatrix();
+    n->bounds = computeBounds();
+    createdCount++;
+    if (primitive)
+        currentArena->primitives->insert({key, *this});
+}
+
+
+size_t Solid::createdNodes()
+{
+    return createdCount;
+}
+
+
+Solid Solid::cube(double sx, double sy, double sz)
+{
+    return Solid(CubeKind, sx, sy, sz, 0);
+}
+
+
+Solid Solid::cylinder(double r, double height, int faces)
+{
+    return Solid(CylinderKind, r, r, height, faces);
+}
+
+
+Solid Solid::cone(double r1, double r2, double height, int faces)
+{
+    return Solid(CylinderKind, r1, r2, height, faces);
+}
+
+
+Solid Solid::sphere(double r, int faces)
+{
+    return Solid(SphereKind, r, faces, 0, 0);
+}
+
+
+Solid Solid::roundedRect(double sx, double sy, double height, double radius, int faces)
+{
+    return Solid(RoundedRectKind, sx, sy, height, radius, {}, faces);
+}
+
+
+Solid Solid::combine(Kind operation, const std::vector<Solid> & children)
+{
+    return Solid(operation, 0, 0, 0, 0, Children(children.begin(), children.end()));
+}
+
+
+Solid & Solid::translate(double x, double y, double z)
+{
+    *this = Solid(TranslateKind, x, y, z, 0, {*this});
+    return *this;
+}
+
+
+Solid & Solid::rotateEulerZXZ(double phi, double theta, double psi)
+{
+    *this = Solid(RotateEulerZXZKind, phi, theta, psi, 0, {*this});
+    return *this;
+}
+
+
+Solid & Solid::scale(double x, double y, double z)
+{
+    *this = Solid(ScaleKind, x, y, z, 0, {*this});
+    return *this;
+}
+
+
+Solid Solid::translatedCopy(double x, double y, double z) const
+{
+    return Solid(TranslateKind, x, y, z, 0, {*this});
+}
+
+
+Solid Solid::transformedCopy(const Matrix & transform) const
+{
+    Solid copy(*this);
+    copy.create(Node{MatrixKind, {0, 0, 0, 0, 0}, {*this}, Box(), transform});
+    return copy;
+}
+
+
+Solid Solid::operator+(const Solid & other) const
+{
+    return combine(UnionKind, {*this, other});
+}
+
+
+Solid Solid::operator-(const Solid & other) const
+{
+    return combine(DifferenceKind, {*this, other});
+}
+
+
+Solid Solid::operator*(const Solid & other) const
+{
+    return combine(IntersectionKind, {*this, other});
+}
+
+
+Matrix Solid::computeMatrix() const
+{
+    const double * p = node->params;
+    switch (kind()) {
+    case TranslateKind:
+        return Matrix::translation(p[0], p[1], p[2]);
+    case RotateEulerZXZKind:
+        // Rotate around z by phi, then around x by theta, then around z by psi
+        return Matrix::rotationZ(p[2]) * Matrix::rotationX(p[1]) * Matrix::rotationZ(p[0]);
+    case ScaleKind:
+        return Matrix::scaling(p[0], p[1], p[2]);
+    default:
+        return Matrix::identity();
+    }
+}
+
+
+std::vector<Point> roundedRectOutline(double sx, double sy, double radius, int faces)
+{
+    if (radius <= 0)
+        return {{0, 0}, {sx, 0}, {sx, sy}, {0, sy}};
+
+    // Each corner is a quarter of a circle with the given number of faces
+    int segments = std::max(1, (faces + 3) / 4);
+    Point centers[4] = {{sx - radius, radius}, {sx - radius, sy - radius}, {radius, sy - radius}, {radius, radius}};
+    std::vector<Point> outline;
+    for (int corner = 0; corner < 4; corner++) {
+        for (int i = 0; i <= segments; i++) {
+            double a = M_PI / 2 * (corner - 1) + M_PI / 2 * i / segments;
+            Point p = {centers[corner].x + radius * std::cos(a), centers[corner].y + radius * std::sin(a)};
+            // Straight sides of length 0 would give duplicate points
+            if (!outline.empty() && std::abs(p.x - outline.back().x) < 1e-9 && std::abs(p.y - outline.back().y) < 1e-9)
+                continue;
+            outline.push_back(p);
+        }
+    }
+    if (outline.size() > 1 && std::abs(outline.front().x - outline.back().x) < 1e-9 &&
+            std::abs(outline.front().y - outline.back().y) < 1e-9)
+        outline.pop_back();
+    return outline;
+}
+
+
+Box Solid::computeBounds() const
+{
+    const double * p = node->params;
+    Box box;
+    switch (kind()) {
+    case CubeKind:
+        box.extend(Vec{0, 0, 0});
+        box.extend(Vec{p[0], p[1], p[2]});
+        return box;
+    case RoundedRectKind:
+        box.extend(Vec{0, 0, 0});
+        box.extend(Vec{p[0], p[1], p[2]});
+        return box;
+    case CylinderKind: {
+        double r = std::max(p[0], p[1]);
+        box.extend(Vec{-r, -r, 0});
+        box.extend(Vec{r, r, p[2]});
+        return box;
+    }
+    case SphereKind:
+        box.extend(Vec{-p[0], -p[0], -p[0]});
+        box.extend(Vec{p[0], p[0], p[0]});
+        return box;
+
+    case TranslateKind:
+        // The most common transform, without a matrix
+        box = children()[0].bounds();
+        if (!box.empty()) {
+            box.min += Vec{p[0], p[1], p[2]};
+            box.max += Vec{p[0], p[1], p[2]};
+        }
+        return box;
+    case RotateEulerZXZKind:
+    case ScaleKind:
+    case MatrixKind:
+        return matrix() * children()[0].bounds();
+
+    case DifferenceKind:
+        return children().empty() ? box : children()[0].bounds();
+    case IntersectionKind:
+        for (size_t i = 0; i < children().size(); i++) {
+            Box b = children()[i].bounds();
+            box = (i == 0) ? b : box.intersection(b);
+        }
+        return box;
+    case UnionKind:
+    case HullKind:
+        for (const Solid & child : children())
+            box.extend(child.bounds());
+        return box;
+    }
+    return box;
+}
+
+
+size_t Solid::primitiveFacets() const
+{
+    const double * p = node->params;
+    switch (kind()) {
+    case CubeKind:
+        return 12;
+    case CylinderKind:
+        // Sides as quads, two caps as fans (a cone has the same count)
+        return 4 * size_t(p[3]) - 4;
+    case SphereKind: {
+        // (n + 1) / 2 rings of n vertices, quads between them and a cap on each end
+        size_t n = p[1];
+        size_t rings = (n + 1) / 2;
+        return 2 * n * (rings - 1) + 2 * (n - 2);
+    }
+    case RoundedRectKind:
+        // Prism over the outline, like a cylinder
+        return 4 * roundedRectOutline(p[0], p[1], p[3], p[4]).size() - 4;
+    default:
+        break;
+    }
+
+    size_t facets = 0;
+    for (const Solid & child : children())
+        facets += child.primitiveFacets();
+    return facets;
+}
+
+
+Component Solid::toComponent() const
+{
+    const double * p = node->params;
+    switch (kind()) {
+    case CubeKind:
+        return Cube(p[0], p[1], p[2], false);
+    case CylinderKind:
+        if (p[0] == p[1])
+            return Cylinder(p[0], p[2], p[3], false);
+        return Cylinder(p[0], p[1], p[2], p[3], false);
+    case SphereKind:
+        return Sphere(p[0], p[1]);
+    case RoundedRectKind: {
+        // OOML has no 2D shapes, but the hull of a cylinder in each corner is the same
+        if (p[3] <= 0)
+            return Cube(p[0], p[1], p[2], false);
+        CompositeComponent hull = Hull::create();
+        for (int corner = 0; corner < 4; corner++) {
+            Component c = Cylinder(p[3], p[2], p[4], false);
+            c.translate((corner & 1) ? p[0] - p[3] : p[3], (corner & 2) ? p[1] - p[3] : p[3], 0);
+            hull.addComponent(c);
+        }
+        return hull;
+    }
+
+    case TranslateKind:
+    case RotateEulerZXZKind:
+    case ScaleKind: {
+        Component c = children()[0].toComponent();
+        if (kind() == TranslateKind)      c.translate(p[0], p[1], p[2]);
+        if (kind() == RotateEulerZXZKind) c.rotateEulerZXZ(p[0], p[1], p[2]);
+        if (kind() == ScaleKind)          c.scale(p[0], p[1], p[2]);
+        return c;
+    }
+    case MatrixKind: {
+        // A mirror along y (if any), a rotation and a translation
+        const Matrix & m = matrix();
+        Matrix r = m;
+        bool mirrored = m.determinant() < 0;
+        if (mirrored) {
+            for (int i = 0; i < 3; i++)
+                r.m[i][1] = -r.m[i][1];
+        }
+        // r = rotationZ(psi) * rotationX(theta) * rotationZ(phi)
+        double theta = std::acos(std::max(-1.0, std::min(1.0, r.m[2][2])));
+        double phi = 0, psi;
+        if (std::abs(std::sin(theta)) > 1e-12) {
+            phi = std::atan2(r.m[2][0], r.m[2][1]);
+            psi = std::atan2(r.m[0][2], -r.m[1][2]);
+        } else {
+            psi = std::atan2(r.m[1][0], r.m[0][0]);
+        }
+        Component c = children()[0].toComponent();
+        if (mirrored)
+            c.scale(1, -1, 1);
+        c.rotateEulerZXZ(phi * 180 / M_PI, theta * 180 / M_PI, psi * 180 / M_PI);
+        c.translate(m.m[0][3], m.m[1][3], m.m[2][3]);
+        return c;
+    }
+
+    case UnionKind:
+    case DifferenceKind:
+    case IntersectionKind:
+    case HullKind: {
+        // Binary unions, differences and intersections are lowered with the OOML operators,
+        // everything else as n-ary composite.
+        if (children().size() == 2 && kind() != HullKind) {
+            Component a = children()[0].toComponent();
+            Component b = children()[1].toComponent();
+            if (kind() == UnionKind)      return a + b;
+            if (kind() == DifferenceKind) return a - b;
+            return a * b;
+        }
+        CompositeComponent composite =
+                (kind() == UnionKind)        ? Union::create() :
+                (kind() == DifferenceKind)   ? Difference::create() :
+                (kind() == IntersectionKind) ? Intersection::create() :
+                                               Hull::create();
+        for (const Solid & child : children())
+            composite.addComponent(child.toComponent());
+        return composite;
+    }
+    }
+    return Component();
+}
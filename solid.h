@@ -0,0 +1,169 @@
+#ifndef SOLID_H
+#define SOLID_H
+
+#include <memory>
+#include <vector>
+#include <ooml/components.h>
+#include "geom.h"
+
+
+// Backend independent CSG tree built by the CaseFactory.
+//
+// A tree can be lowered to an OOML Component (to write SCAD files) or
+// evaluated to a mesh directly (see mesh.h). Nodes are immutable and shared
+// between copies, so copying a Solid is cheap. The primitives and transform
+// methods mirror the OOML ones used before, so lowering gives exactly the
+// same Component.
+class Solid
+{
+    template <class T> class Allocator;
+
+public:
+    enum Kind {
+        CubeKind,           // params: size x, y, z; corner at the origin
+        CylinderKind,       // params: r1, r2, height, faces; from z = 0 to height
+        SphereKind,         // params: r, faces; centered at the origin
+        RoundedRectKind,    // params: size x, y, height, corner radius, faces; a rectangle with rounded corners
+                            // (2D offset of a smaller one) extruded from z = 0 to height, corner at the origin
+        TranslateKind,      // params: x, y, z
+        RotateEulerZXZKind, // params: phi, theta, psi (degrees)
+        ScaleKind,          // params: x, y, z
+        MatrixKind,         // no params, see matrix(); only rigid motions and mirrors (see transformedCopy)
+        UnionKind,
+        DifferenceKind,     // first child minus all others
+        IntersectionKind,
+        HullKind
+    };
+
+    typedef std::vector<Solid, Allocator<Solid>> Children;
+
+    //! An empty union
+    Solid();
+
+    static Solid cube(double sx, double sy, double sz);
+    static Solid cylinder(double r, double height, int faces);
+    static Solid cone(double r1, double r2, double height, int faces);
+    static Solid sphere(double r, int faces);
+    static Solid roundedRect(double sx, double sy, double height, double radius, int faces);
+    static Solid combine(Kind operation, const std::vector<Solid> & children);
+
+    // Transformations, applied after all previous ones
+    Solid & translate(double x, double y, double z);
+    Solid & rotateEulerZXZ(double phi, double theta, double psi);
+    Solid & scale(double x, double y, double z);
+    Solid translatedCopy(double x, double y, double z) const;
+
+    //! A copy transformed by the matrix, as one node. The linear part has to
+    //! be orthogonal (rotations and mirrors only), as OOML can't express
+    //! anything else as one transformation (see toComponent).
+    Solid transformedCopy(const Matrix & transform) const;
+
+    Solid operator+(const Solid & other) const;
+    Solid operator-(const Solid & other) const;
+    Solid operator*(const Solid & other) const;
+
+    Kind kind() const { return node->kind; }
+    double param(int i) const { return node->params[i]; }
+    const Children & children() const { return node->children; }
+
+    // Identity of the node, equal for copies of the same Solid
+    const void * identity() const { return node.get(); }
+
+    bool isPrimitive() const { return kind() <= RoundedRectKind; }
+    bool isTransform() const { return kind() >= TranslateKind && kind() <= MatrixKind; }
+
+    // Transformation of a transform node (the identity for all others)
+    const Matrix & matrix() const { return node->transform; }
+
+    // Box containing the solid (not necessarily the smallest one)
+    const Box & bounds() const { return node->bounds; }
+
+    // Number of triangles of all primitives in the tree, tessellated like
+    // OpenSCAD does. This is the input size of the booleans.
+    size_t primitiveFacets() const;
+
+    Component toComponent() const;
+
+    // Number of nodes created so far on the calling thread (see trace.h)
+    static size_t createdNodes();
+
+private:
+    friend class SolidArena;
+    struct Storage;
+
+    // Takes the memory from the arena of the calling thread, if any (see SolidArena), else from the heap. Holds
+    // the arena, so its memory lives as long as the nodes in it.
+    template <class T>
+    class Allocator
+    {
+    public:
+        typedef T value_type;
+
+        Allocator() : storage(currentStorage()) {}
+        template <class U> Allocator(const Allocator<U> & other) : storage(other.storage) {}
+
+        T * allocate(size_t n) { return static_cast<T *>(allocateMemory(storage.get(), n * sizeof(T))); }
+        void deallocate(T * p, size_t) { if (!storage) ::operator delete(p); }
+
+        template <class U> bool operator==(const Allocator<U> & other) const { return storage == other.storage; }
+        template <class U> bool operator!=(const Allocator<U> & other) const { return storage != other.storage; }
+
+    private:
+        template <class U> friend class Allocator;
+        std::shared_ptr<Storage> storage;
+    };
+
+    // The arena of the calling thread (null if none) and allocation from an arena or the heap
+    static std::shared_ptr<Storage> currentStorage();
+    static void * allocateMemory(Storage * storage, size_t size);
+
+    struct Node {
+        Kind kind;
+        double params[5];
+        Children children;
+        Box bounds; // computed once when the node is created, from the bounds of the children
+        Matrix transform;
+    };
+
+    Box computeBounds() const;
+    Matrix computeMatrix() const;
+
+    Solid(Kind kind, double p0, double p1, double p2, double p3, Children children = Children(), double p4 = 0);
+    void create(Node && created);
+
+    std::shared_ptr<const Node> node;
+};
+
+
+// While it exists, the nodes of all Solids created on the calling thread are
+// taken from a few large blocks instead of one heap allocation each, and
+// primitives are interned: creating a primitive equal to one created before
+// in the scope gives the same node. Solids may outlive the scope (and be used
+// on other threads); the blocks are freed with the last node in them. Scopes
+// nest, the innermost one is used. For one part at a time, see
+// CaseFactory::constructPart.
+class SolidArena
+{
+public:
+    SolidArena();
+    ~SolidArena();
+
+    SolidArena(const SolidArena &) = delete;
+    SolidArena & operator=(const SolidArena &) = delete;
+
+private:
+    friend class Solid;
+    struct Primitives;
+
+    std::shared_ptr<Solid::Storage> storage;
+    std::unique_ptr<Primitives> primitives;
+    SolidArena * outer;
+};
+
+
+// Outline of a RoundedRectKind solid, counter-clockwise. Each corner gets a
+// quarter of the faces of a full circle, like OpenSCAD's offset().
+std::vector<Point> roundedRectOutline(double sx, double sy, double radius, int faces);
+
+
+#endif // SOLID_H
@@ -0,0 +1,180 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "clearance.h"
+
+
+
+std::atomic<bool> Trace::active{false};
+
+typedef std::chrono::steady_clock Clock;
+
+static std::mutex eventsMutex;
+static std::vector<Trace::Event> events;
+static Clock::time_point enableTime;
+
+// Small thread numbers in the order threads first record an event
+static int threadNumber()
+{
+    static std::atomic<int> threadCount{0};
+    static thread_local int number = ++threadCount;
+    return number;
+}
+
+
+// Maximum nesting of booleans, like CsgStats::depth
+static int booleanDepth(const Solid & solid)
+{
+    int depth = 0;
+    for (const Solid & child : solid.children())
+        depth = std::max(depth, booleanDepth(child));
+    bool boolean = !solid.isPrimitive() && !solid.isTransform();
+    return depth + (boolean ? 1 : 0);
+}
+
+
+
+void Trace::enable()
+{
+    enableTime = Clock::now();
+    active = true;
+}
+
+
+void Trace::record(const Event & event)
+{
+    std::lock_guard<std::mutex> lock(eventsMutex);
+    events.push_back(event);
+}
+
+
+bool Trace::writeJson(const std::string & fileName)
+{
+    std::lock_guard<std::mutex> lock(eventsMutex);
+    std::ofstream json(fileName);
+    json << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char * separator = "\n";
+    for (const Event & event : events) {
+        json << separator << "{\"name\": " << jsonString(event.name) << ", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+             << event.thread << ", \"ts\": " << event.start << ", \"dur\": " << event.duration
+             << ", \"args\": {\"nodes\": " << event.nodes;
+        if (!event.detail.empty())
+            json << ", \"detail\": " << jsonString(event.detail);
+        if (event.depth >= 0)
+            json << ", \"depth\": " << event.depth;
+        if (event.bytes >= 0)
+            json << ", \"bytes\": " << event.bytes;
+        json << "}}";
+        separator = ",\n";
+    }
+    json << "\n]}" << std::endl;
+    return bool(json);
+}
+
+
+void Trace::printSummary(std::ostream & out)
+{
+    struct Stage {
+        std::string name;
+        int count = 0;
+        double total = 0; // us
+        double max = 0;
+        size_t nodes = 0;
+        int depth = -1;
+        long long bytes = -1;
+    };
+    std::map<std::string, Stage> byName;
+    {
+        std::lock_guard<std::mutex> lock(eventsMutex);
+        for (const Event & event : events) {
+            Stage & stage = byName[event.name];
+            stage.name = event.name;
+            stage.count++;
+            stage.total += event.duration;
+            stage.max = std::max(stage.max, event.duration);
+            stage.nodes += event.nodes;
+            stage.depth = std::max(stage.depth, event.depth);
+            if (event.bytes >= 0)
+                stage.bytes = std::max(stage.bytes, 0ll) + event.bytes;
+        }
+    }
+    std::vector<Stage> stages;
+    for (auto entry : byName)
+        stages.push_back(entry.second);
+    std::sort(stages.begin(), stages.end(), [](const Stage & a, const Stage & b) { return a.total > b.total; });
+
+    // Stages nest, so the times don't add up
+    out << std::left << std::setw(24) << "Stage" << std::right << std::setw(8) << "count" << std::setw(12) << "total ms"
+        << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << std::setw(10) << "nodes" << std::setw(8) << "depth"
+        << std::setw(12) << "bytes" << std::endl;
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    for (const Stage & stage : stages) {
+        out << std::left << std::setw(24) << stage.name << std::right << std::setw(8) << stage.count
+            << std::setw(12) << stage.total / 1e3 << std::setw(12) << stage.total / 1e3 / stage.count
+            << std::setw(12) << stage.max / 1e3 << std::setw(10) << stage.nodes << std::setw(8);
+        if (stage.depth >= 0)
+            out << stage.depth;
+        else
+            out << "-";
+        out << std::setw(12);
+        if (stage.bytes >= 0)
+            out << stage.bytes;
+        else
+            out << "-";
+        out << std::endl;
+    }
+    out.unsetf(std::ios::floatfield);
+    out.precision(precision);
+}
+
+
+
+TraceScope::TraceScope(const char * name, const std::string & detail) :
+    active(Trace::enabled()),
+    name(name)
+{
+    if (!active)
+        return;
+    this->detail = detail;
+    nodesAtStart = Solid::createdNodes();
+    start = Clock::now();
+}
+
+
+TraceScope::~TraceScope()
+{
+    if (!active)
+        return;
+    Clock::time_point end = Clock::now();
+    Trace::Event event;
+    event.name = name;
+    event.detail = detail;
+    event.thread = threadNumber();
+    event.start = std::chrono::duration<double, std::micro>(start - enableTime).count();
+    event.duration = std::chrono::duration<double, std::micro>(end - start).count();
+    event.nodes = Solid::createdNodes() - nodesAtStart;
+    event.depth = depth;
+    event.bytes = bytes;
+    Trace::record(event);
+}
+
+
+void TraceScope::setResult(const Solid & solid)
+{
+    if (active)
+        depth = booleanDepth(solid);
+}
+
+
+void TraceScope::setBytes(size_t bytes)
+{
+    if (active)
+        this->bytes = bytes;
+}
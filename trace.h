@@ -0,0 +1,77 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "solid.h"
+
+
+// Instrumentation of the generation stages. Once enabled, every TraceScope
+// records its wall time, the CSG nodes created meanwhile on its thread and,
+// where set, the depth of the tree it built and the bytes it wrote. The
+// events can be written in the Chrome trace event format (for
+// chrome://tracing or Perfetto) and summed up per stage. While disabled, a
+// TraceScope only does a relaxed atomic load.
+class Trace
+{
+public:
+    static void enable();
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    //! Writes all events recorded so far as Chrome trace JSON.
+    static bool writeJson(const std::string & fileName);
+
+    //! Prints a table with the count, time, nodes and bytes of each stage,
+    //! the most expensive first.
+    static void printSummary(std::ostream & out);
+
+    // One recorded stage
+    struct Event {
+        std::string name;
+        std::string detail;
+        int thread;
+        double start;    // us since enable()
+        double duration; // us
+        size_t nodes;
+        int depth;       // -1 = not set
+        long long bytes; // -1 = not set
+    };
+
+private:
+    friend class TraceScope;
+
+    static void record(const Event & event);
+
+    static std::atomic<bool> active;
+};
+
+
+// Records one stage, from construction to destruction. name has to be a
+// string literal; detail (like the board or file) is only shown in traces.
+class TraceScope
+{
+public:
+    explicit TraceScope(const char * name) : TraceScope(name, std::string()) {}
+    TraceScope(const char * name, const std::string & detail);
+    ~TraceScope();
+
+    //! Records the boolean depth of the tree built by the stage.
+    void setResult(const Solid & solid);
+
+    //! Records the number of bytes written by the stage.
+    void setBytes(size_t bytes);
+
+private:
+    bool active;
+    const char * name;
+    std::string detail;
+    std::chrono::steady_clock::time_point start;
+    size_t nodesAtStart = 0;
+    int depth = -1;
+    long long bytes = -1;
+};
+
+
+#endif // TRACE_H
@@ -0,0 +1,112 @@
+#include "workpool.h"
+
+#include <algorithm>
+
+
+
+// Index of the worker running on the current thread, -1 outside the pool
+static thread_local int currentWorker = -1;
+
+
+
+WorkPool::WorkPool(unsigned threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned i = 0; i < threadCount; i++)
+        queues.emplace_back(new Queue);
+    for (unsigned i = 0; i < threadCount; i++)
+        threads.emplace_back(&WorkPool::work, this, i);
+}
+
+
+WorkPool::~WorkPool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (auto & thread : threads)
+        thread.join();
+}
+
+
+void WorkPool::submit(std::function<void()> task)
+{
+    unsigned index;
+    if (currentWorker >= 0) {
+        index = currentWorker;
+    } else {
+        std::lock_guard<std::mutex> lock(mutex);
+        index = nextQueue++ % queues.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+
+    // Only count the task once it is in a queue, see work()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued++;
+        unfinished++;
+    }
+    taskAvailable.notify_one();
+}
+
+
+void WorkPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock, [this] { return unfinished == 0; });
+}
+
+
+void WorkPool::work(unsigned index)
+{
+    currentWorker = index;
+    for (;;) {
+        // Claim one of the queued tasks. After that, one is guaranteed to be left in some queue for us.
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskAvailable.wait(lock, [this] { return queued > 0 || stopping; });
+            if (queued == 0)
+                return;
+            queued--;
+        }
+
+        std::function<void()> task;
+        while (!take(index, task))
+            std::this_thread::yield();
+        task();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--unfinished == 0)
+            allDone.notify_all();
+    }
+}
+
+
+// Takes a task from the back of the own queue, or steals one from the front of another queue.
+bool WorkPool::take(unsigned index, std::function<void()> & task)
+{
+    for (unsigned i = 0; i < queues.size(); i++) {
+        Queue & queue = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,59 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// A fixed set of worker threads running submitted tasks.
+//
+// Every worker has its own task queue. Tasks submitted from outside are
+// distributed round-robin, tasks submitted by a task go to the queue of the
+// worker running it. A worker takes tasks from the back of its own queue
+// and, once that is empty, steals from the front of the other queues, so
+// no core is left idle while there is work.
+class WorkPool
+{
+public:
+    //! threadCount 0 means one thread per core.
+    explicit WorkPool(unsigned threadCount = 0);
+
+    //! Waits for all tasks, then stops the threads.
+    ~WorkPool();
+
+    void submit(std::function<void()> task);
+
+    //! Blocks until all submitted tasks have finished.
+    void wait();
+
+    unsigned threadCount() const { return threads.size(); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void work(unsigned index);
+    bool take(unsigned index, std::function<void()> & task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    // Guards the counters below
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable allDone;
+    size_t queued = 0;     // tasks in the queues not yet claimed by a worker
+    size_t unfinished = 0; // tasks submitted but not yet finished
+    unsigned nextQueue = 0;
+    bool stopping = false;
+};
+
+
+#endif // WORKPOOL_H